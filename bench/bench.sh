@@ -0,0 +1,23 @@
+#!/bin/sh
+# bench.sh - builds and runs every benchmark in this directory
+#
+# usage:  sh bench.sh [output directory for the binaries]
+# CC and CFLAGS are taken from the environment (default gcc -O2).
+
+set -e
+cd "$(dirname "$0")"
+out=${1:-/tmp}
+CC=${CC:-gcc}
+CFLAGS=${CFLAGS:--O2}
+
+$CC $CFLAGS -o "$out/evq_bench" evq_bench.c -lm
+$CC $CFLAGS -o "$out/exp_bench" exp_bench.c -lm
+for n in 1 2 3 4; do
+	$CC $CFLAGS -DSCENARIO=$n -o "$out/sim_bench$n" sim_bench.c -lm
+done
+
+"$out/evq_bench"
+"$out/exp_bench"
+for n in 1 2 3 4; do
+	"$out/sim_bench$n"
+done
@@ -0,0 +1,82 @@
+/* program evq_bench.c */
+
+/* Classic "hold" benchmark of the pending event set: the queue is
+   primed with n events, then each operation removes the earliest event
+   and schedules a new one a negexp time later, so the pending set
+   stays at n.  Reports events/sec and ns/event for every scheduler in
+   evq.h against the original sorted list.
+
+   build:  gcc -O2 -o evq_bench evq_bench.c -lm
+   usage:  evq_bench [max pending events] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../common/evq.h"
+
+#define NINC	65536        /* precomputed negexp increments */
+#define OPS	2000000      /* hold operations per measurement */
+#define LIST_MAX	4096     /* the list is too slow to measure beyond this */
+
+double inc[NINC];
+
+double now(void) /* monotonic wall clock in seconds */
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* one hold run of queue type QTYPE with n pending events; leaves the
+   cost per event in ns and checks events come out in time order */
+#define HOLD(QTYPE, PUSH, POP, FREE, SETUP)                           \
+{                                                                     \
+	QTYPE q = {0};                                                    \
+	double t = 0.0, last = 0.0, t0;                                   \
+	long i, ops = OPS;                                                \
+	SETUP;                                                            \
+	for (i = 0; i < n; ++i)                                           \
+		PUSH(&q, inc[i % NINC], 1);                                   \
+	if (n >= 1024 && ops > 200L * n)                                  \
+		ops = 200L * n;                                               \
+	t0 = now();                                                       \
+	for (i = 0; i < ops; ++i) {                                       \
+		POP(&q, &t);                                                  \
+		if (t < last) {                                               \
+			fprintf(stderr, "order violated at op %ld\n", i);         \
+			exit(1);                                                  \
+		}                                                             \
+		last = t;                                                     \
+		PUSH(&q, t + inc[i & (NINC - 1)], 1);                         \
+	}                                                                 \
+	ns = (now() - t0) * 1e9 / ops;                                    \
+	FREE(&q);                                                         \
+}
+
+/**************************************************************************/
+int main(int argc, char *argv[]){
+	unsigned short xsubi[3] = {0x330e, 0x1234, 0x5678};
+	int max = argc > 1 ? atoi(argv[1]) : 262144;
+	int i, n;
+	double ns;
+
+	for (i = 0; i < NINC; ++i)
+		inc[i] = -log(erand48(xsubi));
+
+	printf("%-10s %10s %14s %10s\n", "scheduler", "pending", "events/sec", "ns/event");
+	for (n = 2; n <= max; n *= 4) {
+		if (n <= LIST_MAX) {
+			HOLD(LISTQ, listq_push, listq_pop, listq_free, (void) 0);
+			printf("%-10s %10d %14.0f %10.1f\n", "list", n, 1e9 / ns, ns);
+		}
+		HOLD(HEAPQ, heapq_push, heapq_pop, heapq_free, q.arity = 2);
+		printf("%-10s %10d %14.0f %10.1f\n", "heap2", n, 1e9 / ns, ns);
+		HOLD(HEAPQ, heapq_push, heapq_pop, heapq_free, q.arity = 4);
+		printf("%-10s %10d %14.0f %10.1f\n", "heap4", n, 1e9 / ns, ns);
+		HOLD(CALQ, calq_push, calq_pop, calq_free, (void) 0);
+		printf("%-10s %10d %14.0f %10.1f\n", "calendar", n, 1e9 / ns, ns);
+	}
+	return 0;
+}
@@ -0,0 +1,118 @@
+/* program exp_bench.c */
+
+/* Cost and accuracy of the negexp() kernels: the original scalar
+   -log(erand48()) against the buffered ziggurat and inversion kernels of
+   expgen.h.  For each kernel it prints ns/variate, then checks the
+   sample mean and variance (both 1 for a unit exponential), the
+   Kolmogorov-Smirnov distance to 1-exp(-x) and a chi-square statistic
+   over EXP_BINS equiprobable bins.
+
+   build:  gcc -O2 -o exp_bench exp_bench.c -lm
+   usage:  exp_bench [number of variates] */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../common/rng.h"
+#include "../common/expgen.h"
+
+#define EXP_BINS	100
+#define CHI2_CRIT	135.8	/* 99th percentile of chi-square with 99 df */
+
+double now(void) /* monotonic wall clock in seconds */
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int cmp(const void *a, const void *b)
+{
+	double x = *(const double *) a, y = *(const double *) b;
+	return x < y ? -1 : x > y;
+}
+
+/**************************************************************************/
+int check(const char *name, double *x, long n, double ns)
+/* prints the timing and goodness of fit of the n variates in x */
+{
+	long i, bin[EXP_BINS] = {0};
+	double sum = 0, sum2 = 0, mean, var, d, dmax = 0, chi2 = 0, e;
+	int ok;
+
+	for (i = 0; i < n; ++i) {
+		sum += x[i];
+		sum2 += x[i] * x[i];
+		/* bin k holds F(x) in [k/EXP_BINS, (k+1)/EXP_BINS) */
+		bin[(int) ((1.0 - exp(-x[i])) * EXP_BINS) % EXP_BINS]++;
+	}
+	mean = sum / n;
+	var = sum2 / n - mean * mean;
+	qsort(x, n, sizeof(double), cmp);
+	for (i = 0; i < n; ++i) {
+		d = fabs(1.0 - exp(-x[i]) - (i + 0.5) / n);
+		if (d > dmax)
+			dmax = d;
+	}
+	dmax += 0.5 / n;
+	e = (double) n / EXP_BINS;
+	for (i = 0; i < EXP_BINS; ++i)
+		chi2 += (bin[i] - e) * (bin[i] - e) / e;
+	ok = fabs(mean - 1) < 5 / sqrt(n) && fabs(var - 1) < 15 / sqrt(n) &&
+	     dmax < 1.63 / sqrt(n) && chi2 < CHI2_CRIT;
+	printf("%-10s %8.2f %9.5f %9.5f %9.6f %8.1f  %s\n",
+	       name, ns, mean, var, dmax, chi2, ok ? "ok" : "FAIL");
+	return ok;
+}
+
+/**************************************************************************/
+int main(int argc, char *argv[]){
+	long n = argc > 1 ? atol(argv[1]) : 4000000;
+	double *x = (double *) malloc(n * sizeof(double));
+	unsigned short xsubi[3];
+	static EXPGEN g;                   /* zeroed: left 0, the defaults */
+	double t0, ns;
+	long i;
+	int ok = 1;
+
+	printf("%-10s %8s %9s %9s %9s %8s\n",
+	       "kernel", "ns/draw", "mean", "var", "KS D", "chi2");
+
+	rng_seed(xsubi, 1, 0);
+	t0 = now();
+	for (i = 0; i < n; ++i)
+		x[i] = -log(erand48(xsubi));
+	ns = (now() - t0) * 1e9 / n;
+	ok &= check("scalar", x, n, ns);
+
+	rng_seed(g.rng, 1, 0);
+	g.kernel = EXPGEN_ZIGGURAT;
+	t0 = now();
+	for (i = 0; i < n; ++i)
+		x[i] = expgen_next(&g);
+	ns = (now() - t0) * 1e9 / n;
+	ok &= check("ziggurat", x, n, ns);
+
+	rng_seed(g.rng, 1, 0);
+	expgen_reset(&g);
+	g.kernel = EXPGEN_INVERSION;
+	t0 = now();
+	for (i = 0; i < n; ++i)
+		x[i] = expgen_next(&g);
+	ns = (now() - t0) * 1e9 / n;
+	ok &= check("inversion", x, n, ns);
+
+	rng_seed(g.rng, 1, 0);
+	expgen_reset(&g);
+	g.antithetic = 1;
+	t0 = now();
+	for (i = 0; i < n; ++i)
+		x[i] = expgen_next(&g);
+	ns = (now() - t0) * 1e9 / n;
+	ok &= check("antithetic", x, n, ns);
+
+	free(x);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,238 @@
+/* program sim_bench.c */
+
+/* Cost of the simulator hot paths for one scenario of gateway.h: the
+   schedule()/act() pair at several pending-set depths, the packet
+   buffer append/remove at several queue depths, one negexp() draw, and
+   a full run at several arrival rates, and for the scenarios lanes.h
+   runs, LANES such runs in lockstep.  Each line gives events/sec and
+   ns/event, the best of BEST_OF timings, for a fixed seed and a fixed
+   amount of work, so runs on one machine are comparable as the engine
+   changes.
+
+   The admission policy is compiled in, so the scenario is chosen when
+   building:
+
+     -DSCENARIO=1  question1/r_ssq_n.c  utilisation + drop-tail, 30 KB
+     -DSCENARIO=2  question2/r_ssq_n.c  utilisation + drop-tail, 41 KB
+     -DSCENARIO=3  question3/q3.c       drop-tail, batch host
+     -DSCENARIO=4  question4/q4.c       weighted fair discard, delays
+
+   build:  gcc -O2 -DSCENARIO=4 -o sim_bench4 sim_bench.c -lm
+           (-march=native for the lanes lines to mean anything)
+   usage:  sim_bench4 [arrivals per run]
+   bench.sh builds and runs every scenario and the other benchmarks. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../common/rng.h"
+
+#ifndef SCENARIO
+#define SCENARIO	1
+#endif
+
+#if SCENARIO == 1 || SCENARIO == 2
+#define GW_POLICY	gw_admit_util
+#elif SCENARIO == 3
+#define GW_POLICY	gw_admit_droptail
+#define GW_BATCH	1
+#elif SCENARIO == 4
+#define GW_POLICY	gw_admit_fair
+#define GW_BATCH	1
+#define GW_STATS	GW_STAT_DELAY
+#define GW_TICKS	1	/* as q4 runs */
+#else
+#error "SCENARIO must be 1, 2, 3 or 4"
+#endif
+#include "../common/gateway.h"
+#if SCENARIO == 1 || SCENARIO == 2
+#include "../common/lanes.h"
+#endif
+
+#define SEED	1            /* every measurement uses the same streams */
+#define OPS	2000000      /* operations per component measurement */
+#define RUN	200000       /* default arrivals per full run */
+#define BEST_OF	3
+
+#if GW_BATCH
+/* per single-packet host, as for q3/q4 */
+int rates[] = {50, 100, 150, 200};
+#else
+int rates[] = {600, 900, 1125, 1200};
+#endif
+int depths[] = {1, 16, 256, 4096};
+
+#define NELEM(a)	((int) (sizeof(a) / sizeof((a)[0])))
+
+double now(void) /* monotonic wall clock in seconds */
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/**************************************************************************/
+void setup(SIM *s, int iar) /* the scenario's configuration at rate iar */
+{
+	rng_seed(s->arr.rng, SEED, RNG_SUBSTREAMS + 1);
+	rng_seed(s->len.rng, SEED, RNG_SUBSTREAMS + 2);
+	s->r_capacity = 10;
+	s->mean_pkt_length = 1000;
+	s->util_max = 0.9;
+	s->buffer_size = SCENARIO == 1 ? 30 * 1024 : SCENARIO == 2 ? 41 * 1024 : 41984;
+	s->bar = 10;
+	s->hosts = 10;
+	s->batch_hosts = 1;
+	s->discard_r = 0.75 * s->buffer_size;
+	s->discard_z = 0.95;
+	gw_start(s, iar);
+}
+
+void report(const char *what, const char *param, int x, double ns)
+{
+	printf("q%d %-14s %-8s %8d %14.0f %10.1f\n", SCENARIO, what, param, x, 1e9 / ns, ns);
+}
+
+/**************************************************************************/
+double hold(SIM *s, int depth) /* ns per schedule()+act() with depth pending */
+{
+	double t0, best = HUGE_VAL;
+	long i;
+	int k, type;
+
+	for (k = 0; k < BEST_OF; ++k) {
+		setup(s, 1000);
+		for (i = 1; i < depth; ++i)
+			gw_schedule(s, gw_span(expgen_next(&s->arr) * s->iat), ARRIVAL);
+		t0 = now();
+		for (i = 0; i < OPS; ++i) {
+			type = gw_act(s);
+			gw_schedule(s, gw_span(expgen_next(&s->arr) * s->iat), type);
+		}
+		t0 = now() - t0;
+		best = t0 < best ? t0 : best;
+	}
+	return best * 1e9 / OPS;
+}
+
+double buffer(SIM *s, int depth) /* ns per packet append+remove at depth */
+{
+	double t0, best = HUGE_VAL;
+	long i, sum = 0;
+	int k;
+
+	for (k = 0; k < BEST_OF; ++k) {
+		setup(s, 1000);
+		for (i = 1; i < depth; ++i)
+			pktq_push(&s->pktq, (int) i);
+		t0 = now();
+		for (i = 0; i < OPS; ++i) {
+			pktq_push(&s->pktq, (int) i);
+			sum += s->pktq.pkt_len[pktq_front(&s->pktq)];
+			pktq_pop(&s->pktq);
+		}
+		t0 = now() - t0;
+		best = t0 < best ? t0 : best;
+	}
+	if (sum == 42)             /* keeps the loop from being optimised away */
+		printf(" ");
+	return best * 1e9 / OPS;
+}
+
+double draws(SIM *s) /* ns per negexp() draw */
+{
+	double t0, best = HUGE_VAL, sum = 0;
+	long i;
+	int k;
+
+	for (k = 0; k < BEST_OF; ++k) {
+		setup(s, 1000);
+		t0 = now();
+		for (i = 0; i < OPS; ++i)
+			sum += expgen_next(&s->arr) * s->iat;
+		t0 = now() - t0;
+		best = t0 < best ? t0 : best;
+	}
+	if (sum < 0)
+		printf(" ");
+	return best * 1e9 / OPS;
+}
+
+double run(SIM *s, int iar, int arrivals) /* ns per event of a full run */
+{
+	double t0, best = HUGE_VAL;
+	long events = 1;
+	int k;
+
+	for (k = 0; k < BEST_OF; ++k) {
+		setup(s, iar);
+		t0 = now();
+		gw_simulate(s, arrivals);
+		t0 = now() - t0;
+		best = t0 < best ? t0 : best;
+		/* arrivals plus departures of the packets admitted and gone */
+		events = s->narr + (s->total_packets - s->nloss - s->batch_nloss - s->q);
+	}
+	return best * 1e9 / events;
+}
+
+#if SCENARIO == 1 || SCENARIO == 2
+double lanes(SIM *s, LANESIM *l, int iar, int arrivals)
+/* ns per event of LANES runs in lockstep, each on its own streams */
+{
+	double t0, best = HUGE_VAL;
+	long events = 1;
+	int j, k;
+
+	for (k = 0; k < BEST_OF; ++k) {
+		for (j = 0; j < LANES; ++j) {
+			setup(s, iar);
+			rng_seed(s->arr.rng, SEED, (j + 2) * RNG_SUBSTREAMS + 1);
+			rng_seed(s->len.rng, SEED, (j + 2) * RNG_SUBSTREAMS + 2);
+			expgen_reset(&s->arr);
+			expgen_reset(&s->len);
+			s->total_events = arrivals;
+			lanes_load(l, j, s);
+		}
+		events = 0;
+		t0 = now();
+		while ((j = lanes_run(l)) >= 0) {
+			events += l->narr[j] + (l->narr[j] - l->nloss[j] - l->q[j]);
+			lanes_stop(l, j);
+		}
+		t0 = now() - t0;
+		best = t0 < best ? t0 : best;
+	}
+	return best * 1e9 / events;
+}
+#endif
+
+/**************************************************************************/
+int main(int argc, char *argv[]){
+	SIM s = {0};
+	int arrivals = argc > 1 ? atoi(argv[1]) : RUN;
+	int i;
+
+	printf("%-2s %-14s %-8s %8s %14s %10s\n",
+	       "", "component", "", "", "events/sec", "ns/event");
+	for (i = 0; i < NELEM(depths); ++i)
+		report("schedule+act", "pending", depths[i], hold(&s, depths[i]));
+	for (i = 0; i < NELEM(depths); ++i)
+		report("pktq", "queued", depths[i], buffer(&s, depths[i]));
+	report("negexp", "", 0, draws(&s));
+	for (i = 0; i < NELEM(rates); ++i)
+		report("run", "iar", rates[i], run(&s, rates[i], arrivals));
+#if SCENARIO == 1 || SCENARIO == 2
+	{
+		LANESIM *l = lanes_alloc(1);
+
+		for (i = 0; i < NELEM(rates); ++i)
+			report("lanes", "iar", rates[i], lanes(&s, l, rates[i], arrivals));
+		lanes_free(l, 1);
+	}
+#endif
+	gw_free(&s);
+	return 0;
+}
@@ -0,0 +1,229 @@
+/* evlog.h - binary log of every packet event, written by a background thread */
+
+#ifndef EVLOG_H
+#define EVLOG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* One fixed-size record per enqueue, dequeue and drop, for following an
+   admission policy packet by packet.  The simulator only stores each
+   record into the current block; when a block is full it is handed to a
+   writer thread and the simulator goes on filling the other one, so the
+   cost per event is a 24-byte store, and the simulator waits only if the
+   disk falls a whole block behind.
+
+   The file is an EVLOG_HEAD, written last, and then the records:
+
+       time     of the event
+       len      of the packet
+       q_len    octets in the buffer when the packet was admitted or
+                dropped (before it), or after it left
+       share    of q_len, the octets of the packet's class
+       kind     EVLOG_ENQ, EVLOG_DEQ or EVLOG_DROP
+       cls      0 single packets, 1 batch traffic
+
+   The header carries the configuration an admission rule depends on
+   (gw_admit_fair's W needs the hosts of each class and R, Z and B);
+   trace/evdump.c prints a log as text.
+
+   evlog_open() starts the writer, evlog_close() flushes and stops it. */
+
+#define EVLOG_MAGIC	"GWEVLOG1"
+#define EVLOG_BOM	0x01020304u
+#define EVLOG_BLOCK	65536              /* records per block: 1.5 MB */
+
+enum{ EVLOG_ENQ, EVLOG_DEQ, EVLOG_DROP };
+
+typedef struct{
+	char magic[8];                     /* EVLOG_MAGIC, no terminator */
+	uint32_t bom;                      /* EVLOG_BOM as written */
+	uint32_t rec_size;                 /* sizeof(EVLOG_REC) */
+	uint64_t count;                    /* records that follow */
+	int32_t buffer_size;               /* octets */
+	int32_t hosts, batch_hosts;
+	int32_t pad;
+	double discard_r, discard_z;       /* gw_admit_fair's R (octets) and Z */
+	char policy[32];                   /* admission function */
+} EVLOG_HEAD;
+
+typedef struct{
+	double time;
+	int32_t len;
+	int32_t q_len;
+	int32_t share;
+	uint16_t kind;
+	uint16_t cls;
+} EVLOG_REC;
+
+typedef struct{
+	EVLOG_REC *block[2];               /* filled alternately */
+	int cur;                           /* the one being filled */
+	unsigned n;                        /* records in it */
+	EVLOG_HEAD head;
+	int fd;
+	long count;                        /* records logged */
+
+	/* handed over to the writer under lock */
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	const EVLOG_REC *full;             /* block to write, NULL when none */
+	unsigned nfull;
+	int closing;
+	int failed;                        /* a write failed */
+} EVLOG;
+
+/**************************************************************************/
+static inline void *evlog_writer(void *p) /* the writer thread */
+{
+	EVLOG *l = (EVLOG *) p;
+	const char *b;
+	size_t left;
+	ssize_t k;
+
+	pthread_mutex_lock(&l->lock);
+	for (;;) {
+		while (l->full == NULL && !l->closing)
+			pthread_cond_wait(&l->cond, &l->lock);
+		if (l->full == NULL)
+			break;
+		b = (const char *) l->full;
+		left = (size_t) l->nfull * sizeof(EVLOG_REC);
+		pthread_mutex_unlock(&l->lock);
+		while (left > 0) {
+			if ((k = write(l->fd, b, left)) > 0) {
+				b += k;
+				left -= k;
+			}
+			else if (k == 0 || errno != EINTR)
+				break;         /* a signal is retried, anything else fails */
+		}
+		pthread_mutex_lock(&l->lock);
+		l->failed |= left > 0;
+		l->full = NULL;
+		pthread_cond_broadcast(&l->cond);
+	}
+	pthread_mutex_unlock(&l->lock);
+	return NULL;
+}
+
+static inline EVLOG *evlog_open(const char *path)
+/* creates the log at path and starts its writer; NULL after a message */
+{
+	EVLOG *l = (EVLOG *) calloc(1, sizeof(EVLOG));
+
+	if (l == NULL || (l->block[0] = (EVLOG_REC *) malloc(EVLOG_BLOCK * sizeof(EVLOG_REC))) == NULL ||
+	    (l->block[1] = (EVLOG_REC *) malloc(EVLOG_BLOCK * sizeof(EVLOG_REC))) == NULL) {
+		fprintf(stderr, "evlog: out of memory\n");
+		exit(1);
+	}
+	if ((l->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0 ||
+	    lseek(l->fd, sizeof(EVLOG_HEAD), SEEK_SET) < 0) {
+		fprintf(stderr, "evlog: cannot create %s\n", path);
+		free(l->block[0]);
+		free(l->block[1]);
+		free(l);
+		return NULL;
+	}
+	memcpy(l->head.magic, EVLOG_MAGIC, 8);
+	l->head.bom = EVLOG_BOM;
+	l->head.rec_size = sizeof(EVLOG_REC);
+	pthread_mutex_init(&l->lock, NULL);
+	pthread_cond_init(&l->cond, NULL);
+	if (pthread_create(&l->writer, NULL, evlog_writer, l) != 0) {
+		/* without a writer evlog_put() would wait for it for ever */
+		fprintf(stderr, "evlog: cannot start the writer for %s\n", path);
+		pthread_mutex_destroy(&l->lock);
+		pthread_cond_destroy(&l->cond);
+		close(l->fd);
+		unlink(path);
+		free(l->block[0]);
+		free(l->block[1]);
+		free(l);
+		return NULL;
+	}
+	return l;
+}
+
+static inline void evlog_params(EVLOG *l, const char *policy, int buffer_size,
+                                int hosts, int batch_hosts, double discard_r, double discard_z)
+/* records the configuration in the header */
+{
+	strncpy(l->head.policy, policy, sizeof(l->head.policy) - 1);
+	l->head.buffer_size = buffer_size;
+	l->head.hosts = hosts;
+	l->head.batch_hosts = batch_hosts;
+	l->head.discard_r = discard_r;
+	l->head.discard_z = discard_z;
+}
+
+/**************************************************************************/
+static inline void evlog_flush(EVLOG *l)
+/* hands the current block to the writer, once it has written the other */
+{
+	pthread_mutex_lock(&l->lock);
+	while (l->full != NULL)
+		pthread_cond_wait(&l->cond, &l->lock);
+	l->full = l->block[l->cur];
+	l->nfull = l->n;
+	pthread_cond_broadcast(&l->cond);
+	pthread_mutex_unlock(&l->lock);
+	l->cur ^= 1;
+	l->n = 0;
+}
+
+static inline void evlog_put(EVLOG *l, double time, int kind, int len, int cls,
+                             int q_len, int share)
+{
+	EVLOG_REC *r = &l->block[l->cur][l->n];
+
+	r->time = time;
+	r->len = len;
+	r->q_len = q_len;
+	r->share = share;
+	r->kind = (uint16_t) kind;
+	r->cls = (uint16_t) cls;
+	l->count += 1;
+	if (++l->n == EVLOG_BLOCK)
+		evlog_flush(l);
+}
+
+static inline int evlog_close(EVLOG *l)
+/* writes what is left and the header, and frees l; returns 0, or -1
+   after a message */
+{
+	int bad;
+	ssize_t k;
+
+	if (l->n > 0)
+		evlog_flush(l);
+	pthread_mutex_lock(&l->lock);
+	l->closing = 1;
+	pthread_cond_broadcast(&l->cond);
+	pthread_mutex_unlock(&l->lock);
+	pthread_join(l->writer, NULL);
+
+	l->head.count = l->count;
+	do
+		k = l->failed ? 0 : pwrite(l->fd, &l->head, sizeof(EVLOG_HEAD), 0);
+	while (k < 0 && errno == EINTR);
+	bad = k != sizeof(EVLOG_HEAD);
+	bad |= close(l->fd) != 0;
+	if (bad)
+		fprintf(stderr, "evlog: cannot write the log\n");
+	pthread_mutex_destroy(&l->lock);
+	pthread_cond_destroy(&l->cond);
+	free(l->block[0]);
+	free(l->block[1]);
+	free(l);
+	return bad ? -1 : 0;
+}
+
+#endif /* EVLOG_H */
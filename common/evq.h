@@ -0,0 +1,606 @@
+/* evq.h - pending event set shared by the gateway simulators */
+
+#ifndef EVQ_H
+#define EVQ_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pool.h"
+#include "snap.h"
+
+/* Three interchangeable implementations of the future event list used
+   by schedule() and act():
+
+     EVQ_LIST      sorted singly linked list (the original scheduler),
+                   O(n) insert, O(1) removal of the next event
+     EVQ_HEAP      implicit d-ary heap in one array (binary or 4-ary),
+                   O(log n) insert and removal
+     EVQ_CALENDAR  calendar queue (R. Brown, CACM 1988), O(1) expected
+                   insert and removal for large pending sets
+
+   The implementation is chosen at build time with -DEVQ_IMPL=EVQ_HEAP
+   (the default), EVQ_LIST or EVQ_CALENDAR.  Building with
+   -DEVQ_IMPL=EVQ_RUNTIME compiles all three and picks one at run time
+   from the EVQ environment variable ("list", "heap", "heap2" or
+   "calendar").
+
+   The list and calendar nodes come from a per-queue POOL, so evq_reset()
+   empties a queue in O(1) and keeps its memory for the next replication.
+   A zero-initialised queue is a valid empty queue, so a global EVQ
+   needs no explicit set-up before the first evq_push().
+
+   Built with -DEVQ_COUNT=1, every queue also counts the entries it steps
+   over (list nodes and calendar days passed, heap levels sifted) and the
+   times it called malloc, since the last evq_reset(); evq_walked() and
+   evq_allocs() return them, and 0 when not counting.
+
+   Events with the same time leave the list and the calendar queue in
+   the order they were pushed; the heap takes them in an order that
+   depends on its shape, so a heap build and a list build can part ways
+   at a tie.
+
+   evq_save() appends the pending events to a snap.h snapshot, in an
+   order that evq_load(), pushing them into an empty queue of the same
+   implementation, turns back into the same order of removal, ties
+   included: the list and the calendar queue save theirs in that order,
+   the heap its array, which pushed back in order is rebuilt as it was.
+
+   Event times are doubles unless EVQ_TIME names another arithmetic type
+   before the include (gateway.h's GW_TICKS makes them long long). */
+
+#define EVQ_RUNTIME	0
+#define EVQ_LIST	1
+#define EVQ_HEAP	2
+#define EVQ_CALENDAR	3
+
+#ifndef EVQ_IMPL
+#define EVQ_IMPL	EVQ_HEAP
+#endif
+
+#ifndef EVQ_COUNT
+#define EVQ_COUNT	0
+#endif
+
+#if EVQ_COUNT
+#define EVQ_TALLY(q, what, n)	((q)->what += (n))
+#else
+#define EVQ_TALLY(q, what, n)	((void) 0)
+#endif
+
+#ifndef EVQ_TIME
+#define EVQ_TIME	double
+#endif
+
+#ifndef EVQ_HEAP_ARITY
+#define EVQ_HEAP_ARITY	4	/* children per heap node; 2 or 4 */
+#endif
+
+typedef struct schedule_info{
+	EVQ_TIME time;                     /* Time that event occurs */
+	int event_type;                    /* Type of event */
+	struct schedule_info *next;        /* Pointer to next item in linked list */
+} EVENTLIST;
+
+typedef struct{                        /* a heap entry, and a saved event */
+	EVQ_TIME time;
+	int event_type;
+} HEAPENT;
+
+/**************************************************************************/
+/* sorted linked list */
+
+typedef struct{
+	EVENTLIST *first;                  /* earliest pending event */
+	int size;
+	POOL pool;                         /* storage for the nodes */
+#if EVQ_COUNT
+	long walked, allocs;
+#endif
+} LISTQ;
+
+static inline void listq_push(LISTQ *q, EVQ_TIME time, int type)
+{
+	EVENTLIST **x, *t;
+#if EVQ_COUNT
+	int nchunks = q->pool.nchunks;
+#endif
+
+	/* new events go after pending events with the same time */
+	for (x = &q->first; *x != NULL && (*x)->time <= time; x = &(*x)->next)
+		EVQ_TALLY(q, walked, 1);
+	t = (EVENTLIST *) pool_alloc(&q->pool, sizeof(EVENTLIST));
+	EVQ_TALLY(q, allocs, q->pool.nchunks - nchunks);
+	t->time = time;
+	t->event_type = type;
+	t->next = *x;
+	*x = t;
+	q->size++;
+}
+
+static inline int listq_pop(LISTQ *q, EVQ_TIME *time)
+{
+	EVENTLIST *x = q->first;
+	int type = x->event_type;
+
+	*time = x->time;
+	q->first = x->next;
+	q->size--;
+	pool_put(&q->pool, x);
+	return type;
+}
+
+static inline void listq_reset(LISTQ *q)
+{
+	q->first = NULL;
+	q->size = 0;
+#if EVQ_COUNT
+	q->walked = q->allocs = 0;
+#endif
+	pool_reset(&q->pool);
+}
+
+static inline void listq_free(LISTQ *q)
+{
+	listq_reset(q);
+	pool_free(&q->pool);
+}
+
+static inline void listq_save(LISTQ *q, SNAP *sn)
+{
+	HEAPENT *e;
+	EVENTLIST *x;
+	int i = 0;
+
+	snap_put(sn, &q->size, sizeof(int));
+	e = (HEAPENT *) snap_room(sn, q->size * sizeof(HEAPENT));
+	for (x = q->first; x != NULL; x = x->next, ++i) {
+		e[i].time = x->time;
+		e[i].event_type = x->event_type;
+	}
+}
+
+/**************************************************************************/
+/* implicit d-ary heap */
+
+typedef struct{
+	HEAPENT *ent;                      /* ent[0] is the next event */
+	int size;
+	int cap;
+	int arity;                         /* 0 means EVQ_HEAP_ARITY */
+#if EVQ_COUNT
+	long walked, allocs;
+#endif
+} HEAPQ;
+
+static inline void heapq_push(HEAPQ *q, EVQ_TIME time, int type)
+{
+	int d = q->arity ? q->arity : EVQ_HEAP_ARITY;
+	int i, p;
+
+	if (q->size == q->cap) {
+		q->cap = q->cap ? 2 * q->cap : 64;
+		q->ent = (HEAPENT *) realloc(q->ent, q->cap * sizeof(HEAPENT));
+		if (q->ent == NULL) {
+			fprintf(stderr, "evq: out of memory\n");
+			exit(1);
+		}
+		EVQ_TALLY(q, allocs, 1);
+	}
+	/* sift the hole up from the new leaf */
+	for (i = q->size++; i > 0; i = p) {
+		p = (i - 1) / d;
+		if (q->ent[p].time <= time)
+			break;
+		q->ent[i] = q->ent[p];
+		EVQ_TALLY(q, walked, 1);
+	}
+	q->ent[i].time = time;
+	q->ent[i].event_type = type;
+}
+
+static inline int heapq_pop(HEAPQ *q, EVQ_TIME *time)
+{
+	int d = q->arity ? q->arity : EVQ_HEAP_ARITY;
+	int type = q->ent[0].event_type;
+	int n = --q->size;
+	int i = 0, c, k, m;
+	HEAPENT last = q->ent[n];
+
+	*time = q->ent[0].time;
+	/* sift the hole down from the root, then drop the last leaf into it */
+	for (;;) {
+		c = d * i + 1;
+		if (c >= n)
+			break;
+		m = c;
+		for (k = c + 1; k < c + d && k < n; ++k)
+			if (q->ent[k].time < q->ent[m].time)
+				m = k;
+		if (last.time <= q->ent[m].time)
+			break;
+		q->ent[i] = q->ent[m];
+		i = m;
+		EVQ_TALLY(q, walked, 1);
+	}
+	q->ent[i] = last;
+	return type;
+}
+
+static inline void heapq_reset(HEAPQ *q)
+{
+	q->size = 0;
+#if EVQ_COUNT
+	q->walked = q->allocs = 0;
+#endif
+}
+
+static inline void heapq_free(HEAPQ *q)
+{
+	free(q->ent);
+	q->ent = NULL;
+	q->size = q->cap = 0;
+}
+
+static inline void heapq_save(HEAPQ *q, SNAP *sn)
+/* in array order: pushed back in that order, no entry moves */
+{
+	snap_put(sn, &q->size, sizeof(int));
+	snap_put(sn, q->ent, q->size * sizeof(HEAPENT));
+}
+
+/**************************************************************************/
+/* calendar queue */
+
+typedef struct{
+	EVENTLIST **bucket;                /* one sorted list per day */
+	int nbuckets;                      /* always a power of two */
+	int size;
+	long long cur;                     /* virtual bucket of the last removal */
+	double width;                      /* length of one day */
+	EVQ_TIME lastprio;                 /* time of the last removed event */
+	POOL pool;                         /* storage for the nodes */
+#if EVQ_COUNT
+	long walked, allocs;
+#endif
+} CALQ;
+
+#define CALQ_MIN_BUCKETS	2
+
+static inline long long calq_vbucket(CALQ *q, EVQ_TIME time)
+{
+	return (long long) (time / q->width);
+}
+
+static inline void calq_insert(CALQ *q, EVENTLIST *t, int ahead)
+/* after pending events with the same time, as for the list, or ahead of
+   them for a resize putting back the events it took from the front */
+{
+	EVENTLIST **x;
+
+	x = &q->bucket[calq_vbucket(q, t->time) & (q->nbuckets - 1)];
+	for (; *x != NULL && ((*x)->time < t->time || (!ahead && (*x)->time == t->time));
+	     x = &(*x)->next)
+		EVQ_TALLY(q, walked, 1);
+	t->next = *x;
+	*x = t;
+	q->size++;
+}
+
+static inline EVENTLIST *calq_remove(CALQ *q)
+{
+	int mask = q->nbuckets - 1;
+	int i, n, best;
+	EVENTLIST *x;
+
+	/* scan at most one year of days from the last position */
+	for (n = 0; n < q->nbuckets; ++n) {
+		i = q->cur & mask;
+		x = q->bucket[i];
+		if (x != NULL && calq_vbucket(q, x->time) <= q->cur) {
+			q->bucket[i] = x->next;
+			q->size--;
+			q->lastprio = x->time;
+			return x;
+		}
+		q->cur++;
+		EVQ_TALLY(q, walked, 1);
+	}
+	/* nothing due this year: jump straight to the earliest event */
+	EVQ_TALLY(q, walked, q->nbuckets);
+	best = -1;
+	for (i = 0; i < q->nbuckets; ++i)
+		if (q->bucket[i] != NULL &&
+		    (best < 0 || q->bucket[i]->time < q->bucket[best]->time))
+			best = i;
+	x = q->bucket[best];
+	q->bucket[best] = x->next;
+	q->size--;
+	q->lastprio = x->time;
+	q->cur = calq_vbucket(q, x->time);
+	return x;
+}
+
+static inline void calq_resize(CALQ *q, int nbuckets)
+{
+	EVENTLIST *sample[25], **old, *x, *next;
+	int oldn = q->nbuckets;
+	int i, n, m;
+	double sep, avg;
+	EVQ_TIME lastprio = q->lastprio;
+
+	/* estimate the day length from the separation of the next few
+	   events, ignoring outliers, as in Brown's paper */
+	n = q->size < 25 ? q->size : 25;
+	for (i = 0; i < n; ++i)
+		sample[i] = calq_remove(q);
+	if (n > 1) {
+		avg = (double) (sample[n - 1]->time - sample[0]->time) / (n - 1);
+		sep = 0.0;
+		for (i = 1, m = 0; i < n; ++i)
+			if (sample[i]->time - sample[i - 1]->time <= 2.0 * avg) {
+				sep += sample[i]->time - sample[i - 1]->time;
+				m++;
+			}
+		if (m > 0 && sep > 0.0)
+			q->width = 3.0 * sep / m;
+	}
+	for (i = n - 1; i >= 0; --i)
+		calq_insert(q, sample[i], 1);
+	q->lastprio = lastprio;
+
+	old = q->bucket;
+	q->bucket = (EVENTLIST **) calloc(nbuckets, sizeof(EVENTLIST *));
+	if (q->bucket == NULL) {
+		fprintf(stderr, "evq: out of memory\n");
+		exit(1);
+	}
+	EVQ_TALLY(q, allocs, 1);
+	q->nbuckets = nbuckets;
+	q->size = 0;
+	for (i = 0; i < oldn; ++i)
+		for (x = old[i]; x != NULL; x = next) {
+			next = x->next;
+			calq_insert(q, x, 0);
+		}
+	free(old);
+	q->cur = calq_vbucket(q, q->lastprio);
+}
+
+static inline void calq_push(CALQ *q, EVQ_TIME time, int type)
+{
+	EVENTLIST *t;
+#if EVQ_COUNT
+	int nchunks = q->pool.nchunks;
+#endif
+
+	if (q->bucket == NULL) {
+		q->nbuckets = CALQ_MIN_BUCKETS;
+		q->bucket = (EVENTLIST **) calloc(q->nbuckets, sizeof(EVENTLIST *));
+		if (q->width <= 0.0)
+			q->width = 1.0;
+		q->cur = calq_vbucket(q, q->lastprio);
+		EVQ_TALLY(q, allocs, 1);
+	}
+	t = (EVENTLIST *) pool_alloc(&q->pool, sizeof(EVENTLIST));
+	EVQ_TALLY(q, allocs, q->pool.nchunks - nchunks);
+	t->time = time;
+	t->event_type = type;
+	calq_insert(q, t, 0);
+	if (q->size > 2 * q->nbuckets)
+		calq_resize(q, 2 * q->nbuckets);
+}
+
+static inline int calq_pop(CALQ *q, EVQ_TIME *time)
+{
+	EVENTLIST *x = calq_remove(q);
+	int type = x->event_type;
+
+	*time = x->time;
+	pool_put(&q->pool, x);
+	if (q->size < q->nbuckets / 2 && q->nbuckets > CALQ_MIN_BUCKETS)
+		calq_resize(q, q->nbuckets / 2);
+	return type;
+}
+
+static inline void calq_reset(CALQ *q)
+{
+	if (q->bucket != NULL)
+		memset(q->bucket, 0, q->nbuckets * sizeof(EVENTLIST *));
+	q->size = 0;
+	q->lastprio = 0;
+	q->cur = 0;
+#if EVQ_COUNT
+	q->walked = q->allocs = 0;
+#endif
+	pool_reset(&q->pool);
+}
+
+static inline void calq_free(CALQ *q)
+{
+	calq_reset(q);
+	pool_free(&q->pool);
+	free(q->bucket);
+	q->bucket = NULL;
+	q->nbuckets = 0;
+}
+
+static inline void calq_save(CALQ *q, SNAP *sn)
+/* day by day, each front to back: events with the same time share a day,
+   so they keep their order */
+{
+	HEAPENT *e;
+	EVENTLIST *x;
+	int b, i = 0;
+
+	snap_put(sn, &q->size, sizeof(int));
+	e = (HEAPENT *) snap_room(sn, q->size * sizeof(HEAPENT));
+	for (b = 0; b < q->nbuckets; ++b)
+		for (x = q->bucket[b]; x != NULL; x = x->next, ++i) {
+			e[i].time = x->time;
+			e[i].event_type = x->event_type;
+			}
+}
+
+/**************************************************************************/
+/* the EVQ used by schedule() and act() */
+
+#if EVQ_IMPL == EVQ_LIST
+
+typedef LISTQ EVQ;
+#define evq_push	listq_push
+#define evq_pop		listq_pop
+#define evq_reset	listq_reset
+#define evq_free	listq_free
+#define evq_name(q)	"list"
+#define evq_save	listq_save
+
+#elif EVQ_IMPL == EVQ_HEAP
+
+typedef HEAPQ EVQ;
+#define evq_push	heapq_push
+#define evq_pop		heapq_pop
+#define evq_reset	heapq_reset
+#define evq_free	heapq_free
+#define evq_name(q)	(EVQ_HEAP_ARITY == 2 ? "heap2" : "heap")
+#define evq_save	heapq_save
+
+#elif EVQ_IMPL == EVQ_CALENDAR
+
+typedef CALQ EVQ;
+#define evq_push	calq_push
+#define evq_pop		calq_pop
+#define evq_reset	calq_reset
+#define evq_free	calq_free
+#define evq_name(q)	"calendar"
+#define evq_save	calq_save
+
+#elif EVQ_IMPL == EVQ_RUNTIME
+
+typedef struct{
+	int impl;                          /* 0 until the first use */
+	LISTQ list;
+	HEAPQ heap;
+	CALQ cal;
+} EVQ;
+
+static inline int evq_impl(EVQ *q)
+{
+	const char *s;
+
+	if (q->impl == 0) {
+		s = getenv("EVQ");
+		q->impl = EVQ_HEAP;
+		if (s != NULL && strcmp(s, "list") == 0)
+			q->impl = EVQ_LIST;
+		else if (s != NULL && strcmp(s, "calendar") == 0)
+			q->impl = EVQ_CALENDAR;
+		else if (s != NULL && strcmp(s, "heap2") == 0)
+			q->heap.arity = 2;
+	}
+	return q->impl;
+}
+
+static inline void evq_push(EVQ *q, EVQ_TIME time, int type)
+{
+	switch (evq_impl(q)) {
+	case EVQ_LIST:
+		listq_push(&q->list, time, type);
+		break;
+	case EVQ_CALENDAR:
+		calq_push(&q->cal, time, type);
+		break;
+	default:
+		heapq_push(&q->heap, time, type);
+		break;
+	}
+}
+
+static inline int evq_pop(EVQ *q, EVQ_TIME *time)
+{
+	switch (q->impl) {
+	case EVQ_LIST:
+		return listq_pop(&q->list, time);
+	case EVQ_CALENDAR:
+		return calq_pop(&q->cal, time);
+	default:
+		return heapq_pop(&q->heap, time);
+	}
+}
+
+static inline void evq_reset(EVQ *q)
+{
+	listq_reset(&q->list);
+	heapq_reset(&q->heap);
+	calq_reset(&q->cal);
+}
+
+static inline void evq_free(EVQ *q)
+{
+	listq_free(&q->list);
+	heapq_free(&q->heap);
+	calq_free(&q->cal);
+}
+
+static inline void evq_save(EVQ *q, SNAP *sn)
+{
+	switch (evq_impl(q)) {
+	case EVQ_LIST:
+		listq_save(&q->list, sn);
+		break;
+	case EVQ_CALENDAR:
+		calq_save(&q->cal, sn);
+		break;
+	default:
+		heapq_save(&q->heap, sn);
+		break;
+	}
+}
+
+static inline const char *evq_name(EVQ *q)
+{
+	switch (evq_impl(q)) {
+	case EVQ_LIST:
+		return "list";
+	case EVQ_CALENDAR:
+		return "calendar";
+	default:
+		return q->heap.arity == 2 ? "heap2" : "heap";
+	}
+}
+
+#else
+#error "EVQ_IMPL must be EVQ_LIST, EVQ_HEAP, EVQ_CALENDAR or EVQ_RUNTIME"
+#endif
+
+static inline int evq_load(EVQ *q, SNAP *sn)
+/* empties q and pushes the events evq_save() saved; returns 0, or -1 if
+   the snapshot ran out */
+{
+	HEAPENT e;
+	int i, n;
+
+	evq_reset(q);
+	if (snap_get(sn, &n, sizeof(int)) < 0 || n < 0)
+		return -1;
+	for (i = 0; i < n; ++i) {
+		if (snap_get(sn, &e, sizeof(HEAPENT)) < 0)
+			return -1;
+		evq_push(q, e.time, e.event_type);
+	}
+	return 0;
+}
+
+#if !EVQ_COUNT
+#define evq_walked(q)	0L
+#define evq_allocs(q)	0L
+#elif EVQ_IMPL == EVQ_RUNTIME
+#define evq_walked(q)	((q)->list.walked + (q)->heap.walked + (q)->cal.walked)
+#define evq_allocs(q)	((q)->list.allocs + (q)->heap.allocs + (q)->cal.allocs)
+#else
+#define evq_walked(q)	((q)->walked)
+#define evq_allocs(q)	((q)->allocs)
+#endif
+
+#endif /* EVQ_H */
@@ -0,0 +1,174 @@
+/* expgen.h - buffered generator of negative exponential variates */
+
+#ifndef EXPGEN_H
+#define EXPGEN_H
+
+#include <math.h>
+#include <pthread.h>
+
+/* negexp() and the packet lengths used to cost one libm log() per draw.
+   An EXPGEN keeps a block of EXPGEN_BLOCK unit-mean exponential
+   variates and refills the whole block at once, so the per-draw cost is
+   a buffer read; multiply by the mean to scale.
+
+   The uniforms come from the drand48 generator itself (the same 48 bit
+   LCG and the same unsigned short[3] state as erand48()), stepped inline
+   in the refill loop.  Two refill kernels are provided:
+
+     EXPGEN_ZIGGURAT   Marsaglia and Tsang's 256-layer ziggurat; about
+                       98% of draws cost one multiply and one compare,
+                       the rest fall back to exp()/log()
+     EXPGEN_INVERSION  -log(u) over the block; one log per draw but in a
+                       tight loop the compiler can vectorise, and each
+                       variate is a monotone function of its uniform,
+                       which antithetic sampling relies on
+
+   A zero-initialised EXPGEN is valid (an all-zero seed, ziggurat
+   kernel); use rng_seed() on 'rng' for a real stream. */
+
+#define EXPGEN_BLOCK	256
+
+#define EXPGEN_ZIGGURAT		0
+#define EXPGEN_INVERSION	1
+
+typedef struct{
+	double buf[EXPGEN_BLOCK];          /* unread variates are buf[0..left-1] */
+	int left;
+	int kernel;                        /* EXPGEN_ZIGGURAT or EXPGEN_INVERSION */
+	int antithetic;                    /* inversion only: use 1-u for u */
+	unsigned short rng[3];             /* erand48() state */
+} EXPGEN;
+
+/**************************************************************************/
+/* ziggurat tables, built once per process */
+
+static unsigned int expgen_ke[256];
+static double expgen_we[256], expgen_fe[256];
+static pthread_once_t expgen_once = PTHREAD_ONCE_INIT;
+
+static inline void expgen_tables(void)
+{
+	const double m2 = 4294967296.0;
+	double de = 7.697117470131487, te = de, ve = 3.949659822581572e-3;
+	double q = ve / exp(-de);
+	int i;
+
+	expgen_ke[0] = (unsigned int) ((de / q) * m2);
+	expgen_ke[1] = 0;
+	expgen_we[0] = q / m2;
+	expgen_we[255] = de / m2;
+	expgen_fe[0] = 1.0;
+	expgen_fe[255] = exp(-de);
+	for (i = 254; i >= 1; i--) {
+		de = -log(ve / de + exp(-de));
+		expgen_ke[i + 1] = (unsigned int) ((de / te) * m2);
+		te = de;
+		expgen_fe[i] = exp(-de);
+		expgen_we[i] = de / m2;
+	}
+}
+
+/**************************************************************************/
+/* the drand48 recurrence, on a state held in a register */
+
+#define EXPGEN_A	0x5DEECE66DULL
+#define EXPGEN_C	0xBULL
+#define EXPGEN_MASK	((1ULL << 48) - 1)
+
+static inline unsigned long long expgen_load(const unsigned short x[3])
+{
+	return (unsigned long long) x[0] | (unsigned long long) x[1] << 16 |
+	       (unsigned long long) x[2] << 32;
+}
+
+static inline void expgen_store(unsigned short x[3], unsigned long long v)
+{
+	x[0] = (unsigned short) v;
+	x[1] = (unsigned short) (v >> 16);
+	x[2] = (unsigned short) (v >> 32);
+}
+
+static inline unsigned long long expgen_step(unsigned long long x)
+{
+	return (x * EXPGEN_A + EXPGEN_C) & EXPGEN_MASK;
+}
+
+static inline double expgen_open(unsigned long long x)
+/* uniform on the open interval (0,1), so log() is always finite */
+{
+	return ((double) x + 0.5) * (1.0 / 281474976710656.0);
+}
+
+/**************************************************************************/
+static inline void expgen_refill(EXPGEN *g)
+{
+	unsigned long long x = expgen_load(g->rng);
+	unsigned int jz;
+	double u, v;
+	int i, iz;
+
+	if (g->kernel == EXPGEN_INVERSION) {
+		/* uniforms first, then one pass of logs over the block */
+		for (i = 0; i < EXPGEN_BLOCK; ++i) {
+			x = expgen_step(x);
+			g->buf[i] = expgen_open(x);
+		}
+		if (g->antithetic)
+			for (i = 0; i < EXPGEN_BLOCK; ++i)
+				g->buf[i] = 1.0 - g->buf[i];
+		for (i = 0; i < EXPGEN_BLOCK; ++i)
+			g->buf[i] = -log(g->buf[i]);
+	}
+	else {
+		pthread_once(&expgen_once, expgen_tables);
+		/* bit k of the LCG has period 2^(k+1), so the layer takes the
+		   top 8 bits and jz the 32 below them */
+		for (i = 0; i < EXPGEN_BLOCK; ++i) {
+			x = expgen_step(x);
+			jz = (unsigned int) (x >> 8);
+			iz = (int) (x >> 40);
+			if (jz < expgen_ke[iz]) {
+				g->buf[i] = jz * expgen_we[iz];
+				continue;
+			}
+			/* wedge or tail of the ziggurat */
+			for (;;) {
+				if (iz == 0) {
+					x = expgen_step(x);
+					g->buf[i] = 7.69711747013104972 - log(expgen_open(x));
+					break;
+				}
+				v = jz * expgen_we[iz];
+				x = expgen_step(x);
+				u = expgen_open(x);
+				if (expgen_fe[iz] + u * (expgen_fe[iz - 1] - expgen_fe[iz]) < exp(-v)) {
+					g->buf[i] = v;
+					break;
+				}
+				x = expgen_step(x);
+				jz = (unsigned int) (x >> 8);
+				iz = (int) (x >> 40);
+				if (jz < expgen_ke[iz]) {
+					g->buf[i] = jz * expgen_we[iz];
+					break;
+				}
+			}
+		}
+	}
+	expgen_store(g->rng, x);
+	g->left = EXPGEN_BLOCK;
+}
+
+static inline double expgen_next(EXPGEN *g) /* returns a negexp rv with mean 1 */
+{
+	if (g->left == 0)
+		expgen_refill(g);
+	return g->buf[--g->left];
+}
+
+static inline void expgen_reset(EXPGEN *g) /* drops the buffered variates */
+{
+	g->left = 0;
+}
+
+#endif /* EXPGEN_H */
@@ -0,0 +1,786 @@
+/* gateway.h - event loop of the gateway simulators, specialised per program */
+
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#ifndef GW_PROF
+#define GW_PROF		0
+#endif
+#ifndef GW_TRACE
+#define GW_TRACE	0
+#endif
+#ifndef GW_EVLOG
+#define GW_EVLOG	0
+#endif
+#ifndef GW_TILT
+#define GW_TILT		0
+#endif
+#ifndef GW_TICKS
+#define GW_TICKS	0
+#endif
+#if GW_TICKS
+#define EVQ_TIME	long long
+#define PKTQ_TIME	long long
+#define SRCQ_TIME	long long
+#define SRCQ_NEVER	LLONG_MAX
+#endif
+#if GW_PROF && !defined(EVQ_COUNT)
+#define EVQ_COUNT	1
+#endif
+
+#include "evq.h"
+#include "pktq.h"
+#include "srcq.h"
+#include "expgen.h"
+#include "stats.h"
+#if GW_PROF
+#include "prof.h"
+#endif
+#if GW_TRACE
+#include "trace.h"
+#endif
+#if GW_EVLOG
+#include "evlog.h"
+#endif
+
+/* One gateway with a FIFO buffer fed by Poisson arrivals of packets with
+   negexp lengths.  The programs differ only in how a packet is admitted,
+   whether some arrivals come as batches and which statistics are kept;
+   those are chosen before including this file, so each program compiles
+   to a loop with only the code it needs:
+
+     GW_POLICY  admission test, one of the gw_admit_* functions below
+                (default gw_admit_droptail).  A new rule is one more
+                function here with the same signature.
+     GW_BATCH   1: every batch_interval-th arrival brings batch_size
+                packets, and losses are counted per class (default 0)
+     GW_HOSTS   arrivals per ARRIVAL event (default 1)
+     GW_SOURCES 1: each of the hosts sends on its own Poisson process,
+                the batch hosts bar batches a second and the others iar
+                packets, merged through a SRCQ; replaces GW_HOSTS and
+                the every-batch_interval-th rule (default 0: one
+                aggregate process)
+     GW_TRACE   1: arrivals are the records of a trace.h packet trace,
+                read through the cursor the caller sets in s->trace
+                before gw_start(); each brings one packet of the
+                recorded length, a batch packet if its class is 1
+                (default 0: synthetic arrivals)
+     GW_STATS   GW_STAT_DELAY: delay of every departing packet
+                GW_STAT_PEAK: high-water mark of the buffer in octets
+     GW_PROF    1: count events, event-list steps and allocations, and
+                time the event list, RNG, packet buffer and statistics
+                with prof.h; gw_prof_dump() prints them as JSON
+                (default 0: compiled out, and gw_prof_dump() does nothing)
+     GW_EVLOG   1: while s->evlog is set (gw_evlog()), every enqueue,
+                dequeue and drop goes to that evlog.h log (default 0:
+                compiled out)
+     GW_TILT    1: while s->tilted is set, gw_draw() scales the negexp
+                variates by s->tilt[] (interarrival times, packet
+                lengths) and adds up the log likelihood ratio of what it
+                drew in s->log_lr, for importance sampling (tilt.h;
+                default 0: compiled out)
+     GW_TICKS   1: the clock counts integer ticks of 1 ns (GW_CLOCK is
+                long long) instead of seconds in a double, so events keep
+                their exact order however long the run: event times,
+                gmt, packet arrival times and the hosts' send times.
+                Draws are rounded to the tick, service times are a
+                multiply-shift of the packet length, and delays and
+                the event log are converted back to seconds (default 0)
+
+   The caller fills in the configuration part of a SIM, seeds arr.rng and
+   len.rng, and calls gw_start() and then gw_simulate(). */
+
+#ifndef GW_POLICY
+#define GW_POLICY	gw_admit_droptail
+#endif
+#ifndef GW_BATCH
+#define GW_BATCH	0
+#endif
+#ifndef GW_HOSTS
+#define GW_HOSTS	1
+#endif
+#define GW_STAT_DELAY	1
+#define GW_STAT_PEAK	2
+#ifndef GW_SOURCES
+#define GW_SOURCES	0
+#endif
+#ifndef GW_STATS
+#define GW_STATS	0
+#endif
+#if GW_SOURCES && GW_HOSTS != 1
+#error "GW_SOURCES gives every host its own arrivals; leave GW_HOSTS at 1"
+#endif
+#if GW_TRACE && (GW_SOURCES || GW_HOSTS != 1)
+#error "GW_TRACE takes every arrival from the trace; leave GW_SOURCES and GW_HOSTS alone"
+#endif
+
+#define ARRIVAL		1
+#define DEPARTURE	2
+
+/* the clock: seconds, or with GW_TICKS ticks of 1 ns.  GW_NEVER is later
+   than any event; with ticks it leaves gmt + GW_NEVER in range while gmt
+   stays below GW_NEVER, about 146 years, which gw_simulate() checks. */
+#if GW_TICKS
+typedef long long GW_CLOCK;
+#define GW_TICK_HZ	1e9		/* ticks per second */
+#define GW_NEVER	(1LL << 62)
+#define GW_FIX		16		/* fraction bits of byte_fix */
+#else
+typedef double GW_CLOCK;
+#define GW_NEVER	HUGE_VAL
+#endif
+
+/* GW_PROF counters and timers, named in gw_prof_dump() */
+enum{ GW_N_ARRIVAL, GW_N_DEPARTURE, GW_N_PACKET, GW_N_DROP, GW_N_EVQ_WALK,
+      GW_N_EVQ_ALLOC, GW_N_PKTQ_ALLOC, GW_N_PKTQ_PEAK, GW_NCOUNTS };
+enum{ GW_T_EVQ, GW_T_RNG, GW_T_PKTQ, GW_T_STATS, GW_T_TOTAL, GW_NTIMERS };
+
+#if GW_PROF
+#define GW_COUNT(s, i, n)	((s)->prof.count[i] += (n))
+#define GW_TIME(s, i, stmt)	do { PROF_TICK t0_ = prof_tick(); stmt; \
+				     (s)->prof.ticks[i] += prof_tick() - t0_; } while (0)
+#else
+#define GW_COUNT(s, i, n)	((void) 0)
+#define GW_TIME(s, i, stmt)	do { stmt; } while (0)
+#endif
+
+#if GW_EVLOG
+/* the octets of the packet's class are what gw_admit_fair weighs */
+#define GW_LOG(s, kind, len, batch) \
+	do { if ((s)->evlog != NULL) \
+		evlog_put((s)->evlog, gw_seconds((s)->gmt), kind, len, batch, (s)->q_len, \
+		          (batch) ? (s)->batch_qlen : (s)->q_len - (s)->batch_qlen); } while (0)
+#else
+#define GW_LOG(s, kind, len, batch)	((void) 0)
+#endif
+
+/* All of the state of one replication.  Nothing is shared between two
+   SIMs, so any number of them can be run side by side. */
+typedef struct sim_info{
+  /* configuration, set before gw_start() */
+  int
+    r_capacity,        /* router processing capacity in Mbit/s */
+    buffer_size,       /* max buffer size to hold packets, in octets */
+    mean_pkt_length,   /* mean packet length */
+    total_events,      /* number of arrivals to be simulated */
+    bar,               /* GW_BATCH: batch arrival rate per host */
+    hosts,             /* GW_BATCH, GW_SOURCES: number of hosts */
+    batch_hosts;       /* GW_BATCH: hosts that have batch arrivals */
+
+  double
+    util_max,     /* gw_admit_util/budget: drop above this utilisation */
+    loss_budget,  /* gw_admit_budget: drop while loss stays within this */
+    discard_r,    /* gw_admit_fair: occupancy (octets) that starts discard */
+    discard_z;    /* gw_admit_fair: share of the rest a class may exceed */
+
+  /* state */
+  GW_CLOCK
+    gmt;    /* absolute time */
+
+  double
+    iat;    /* mean interarrival time */
+
+  int
+    q,             /* number of packets in the system */
+    q_len,         /* queue length n octets */
+    q_peak,        /* GW_STAT_PEAK: largest q_len so far */
+    batch_qlen,    /* sum of the batch packet lengths in q_len */
+    batch_size,    /* number of packets in each batch arrival */
+    batch_interval;/* every batch_interval-th arrival is a batch */
+
+  long long        /* counters: long runs pass INT_MAX */
+    narr,          /* number of arrivals */
+    nloss,         /* number of lost single arrival packets */
+    batch_nloss,   /* number of lost batch arrival packets */
+    q_sum,         /* sum of queue lengths at arrival instants */
+    total_packets, /* total number of packets that arrived */
+    batch_packets; /* number of them that came in batches */
+
+  double
+    batch_iat,     /* GW_SOURCES: mean time between a batch host's batches */
+    byte_time,     /* service time of one octet */
+    util_octets,   /* q_len above which utilisation exceeds util_max */
+    fair_scale[2]; /* gw_admit_fair thresholds, single and batch */
+
+#if GW_TICKS
+  long long
+    byte_fix;      /* GW_TICKS: ticks per octet, times 2^GW_FIX */
+#endif
+
+  STAT
+    batch_delay,   /* GW_STAT_DELAY: time batched packets spent in the system */
+    packet_delay;  /* and time individual packets spent in it */
+
+  unsigned short
+    rng[3];  /* state of this replication's own erand48() stream */
+
+  EXPGEN
+    arr,    /* buffered negexp variates for interarrival times */
+    len;    /* and for packet lengths, on a stream of their own */
+
+  EVQ
+    evq;    /* pending events, earliest first */
+
+  PKTQ
+    pktq;   /* packets in the buffer, oldest first */
+
+  SRCQ
+    src;    /* GW_SOURCES: next send time of each host */
+
+#if GW_TRACE
+  TRACE_CURSOR
+    trace;  /* GW_TRACE: the records still to arrive */
+#endif
+
+#if GW_EVLOG
+  EVLOG
+    *evlog; /* GW_EVLOG: where the packet events go, or NULL */
+#endif
+
+#if GW_TILT
+  double
+    tilt[2],  /* GW_TILT: scale of the mean interarrival time and of the
+                 mean packet length while tilted */
+    log_lr;   /* log of the likelihood ratio of the draws so far */
+  int
+    tilted;   /* whether tilt[] is in force */
+#endif
+
+#if GW_PROF
+  PROF
+    prof;   /* counters and timers since gw_start() */
+#endif
+  } SIM;
+
+/**************************************************************************/
+/* admission policies: nonzero to admit a packet of len octets, batch
+   saying whether it arrived in a batch.  Written as comparisons combined
+   with & so that they compile without branches. */
+
+static inline int gw_admit_droptail(SIM *s, int len, int batch)
+/* admit while the packet fits in the buffer */
+{
+	(void) batch;
+	return len + s->q_len <= s->buffer_size;
+}
+
+static inline int gw_admit_util(SIM *s, int len, int batch)
+/* drop-tail, and drop everything while the utilisation is above util_max */
+{
+	(void) batch;
+	return (len + s->q_len <= s->buffer_size) & (s->q_len <= s->util_octets);
+}
+
+static inline int gw_admit_budget(SIM *s, int len, int batch)
+/* unbounded buffer: below util_max, drop a packet whenever the loss
+   probability would still be within loss_budget, otherwise admit it */
+{
+	(void) len;
+	(void) batch;
+	return (s->q_len <= s->util_octets) &
+	       (s->nloss + 1 > s->loss_budget * s->narr);
+}
+
+static inline int gw_admit_fair(SIM *s, int len, int batch)
+/* weighted fair discard: once q_len exceeds R, drop the packet if its
+   class's weight W - its share of the buffer relative to its share of
+   the hosts - exceeds Z*(B-R)/(q_len-R).  Multiplied out by q_len and
+   q_len-R, which are positive there, so no division per packet. */
+{
+	double share = batch ? s->batch_qlen : s->q_len - s->batch_qlen;
+
+	(void) len;
+	return !((s->q_len > s->discard_r) &
+	         (share * (s->q_len - s->discard_r) > s->fair_scale[batch] * s->q_len));
+}
+
+/**************************************************************************/
+static inline GW_CLOCK gw_span(double seconds) /* a duration on the clock */
+{
+#if GW_TICKS
+	return seconds < GW_NEVER / GW_TICK_HZ ? (GW_CLOCK) (seconds * GW_TICK_HZ + 0.5) : GW_NEVER;
+#else
+	return seconds;
+#endif
+}
+
+static inline double gw_seconds(GW_CLOCK t) /* a time on the clock in seconds */
+{
+#if GW_TICKS
+	return t / GW_TICK_HZ;
+#else
+	return t;
+#endif
+}
+
+static inline GW_CLOCK gw_service(SIM *s, int len) /* time to send len octets */
+{
+#if GW_TICKS
+	return ((long long) len * s->byte_fix + (1LL << (GW_FIX - 1))) >> GW_FIX;
+#else
+	return len * s->byte_time;
+#endif
+}
+
+static inline void gw_schedule_at(SIM *s, GW_CLOCK time, int event)
+/* schedules an event of type 'event' at absolute time 'time' */
+{
+	GW_TIME(s, GW_T_EVQ, evq_push(&s->evq, time, event));
+}
+
+static inline void gw_schedule(SIM *s, GW_CLOCK time_interval, int event)
+/* schedules an event of type 'event' at time 'time_interval' in the future */
+{
+	gw_schedule_at(s, s->gmt + time_interval, event);
+}
+
+static inline int gw_act(SIM *s) /* find the next event and go to it */
+{
+	int type;
+
+	/* step time forward to the next event and return its type */
+	GW_TIME(s, GW_T_EVQ, type = evq_pop(&s->evq, &s->gmt));
+	return type;
+}
+
+#if GW_TILT
+static inline double gw_tilted(SIM *s, EXPGEN *g, double x)
+/* GW_TILT: x drawn with mean a instead of 1, and the density ratio of
+   real to drawn, a e^-(a-1)x, into the likelihood ratio */
+{
+	double a = s->tilt[g != &s->arr];
+
+	s->log_lr += log(a) - (a - 1) * x;
+	return x * a;
+}
+#endif
+
+static inline double gw_draw(SIM *s, EXPGEN *g) /* a negexp rv with mean 1 */
+{
+	double x;
+
+	(void) s;
+	GW_TIME(s, GW_T_RNG, x = expgen_next(g));
+#if GW_TILT
+	if (s->tilted)
+		x = gw_tilted(s, g, x);
+#endif
+	return x;
+}
+
+/**************************************************************************/
+static inline int gw_enqueue(SIM *s, int len, int batch)
+/* a packet of len octets arrives; returns its slot in the buffer, or
+   -1 if it was dropped */
+{
+	unsigned slot;
+#if GW_PROF
+	unsigned cap = s->pktq.cap;
+#endif
+
+	GW_COUNT(s, GW_N_PACKET, 1);
+	if (GW_POLICY(s, len, batch)) {
+		/* still space in buffer */
+		GW_LOG(s, EVLOG_ENQ, len, batch);
+		s->q += 1;
+		s->q_len += len;
+		GW_TIME(s, GW_T_PKTQ, slot = pktq_push(&s->pktq, len));
+#if GW_PROF
+		/* a grown ring reallocates each of its arrays */
+		if (s->pktq.cap != cap)
+			GW_COUNT(s, GW_N_PKTQ_ALLOC, 1 + !!(s->pktq.fields & PKTQ_ARRIVAL) +
+			                             !!(s->pktq.fields & PKTQ_BATCH));
+		if ((unsigned) s->q > s->prof.count[GW_N_PKTQ_PEAK])
+			s->prof.count[GW_N_PKTQ_PEAK] = s->q;
+#endif
+#if GW_BATCH
+		s->pktq.batch[slot] = batch;
+		s->batch_qlen += batch ? len : 0;
+#endif
+#if GW_STATS & GW_STAT_DELAY
+		s->pktq.arrival_time[slot] = s->gmt;
+#endif
+#if GW_STATS & GW_STAT_PEAK
+		s->q_peak = s->q_len > s->q_peak ? s->q_len : s->q_peak;
+#endif
+		if (s->q == 1)
+			gw_schedule(s, gw_service(s, s->pktq.pkt_len[slot]), DEPARTURE);
+		return (int) slot;
+	}
+	/* packet is dropped */
+	GW_LOG(s, EVLOG_DROP, len, batch);
+	GW_COUNT(s, GW_N_DROP, 1);
+	s->batch_nloss += batch;
+	s->nloss += !batch;
+	return -1;
+}
+
+static inline void gw_packet(SIM *s, int batch) /* one packet arrives */
+{
+	gw_enqueue(s, (int) (gw_draw(s, &s->len) * s->mean_pkt_length), batch);
+}
+
+static inline int gw_source(SIM *s)
+/* GW_SOURCES: the host sending now draws the time of its next send, and
+   the earliest of all the hosts becomes the next ARRIVAL; returns whether
+   the sender is a batch host (hosts 0..batch_hosts-1) */
+{
+	int h = srcq_min(&s->src);
+	int batch = GW_BATCH && h < s->batch_hosts;
+
+	srcq_set(&s->src, h, s->gmt + gw_span(gw_draw(s, &s->arr) * (batch ? s->batch_iat : s->iat)));
+	gw_schedule_at(s, srcq_time(&s->src), ARRIVAL);
+	return batch;
+}
+
+#if GW_TRACE
+static inline void gw_replay(SIM *s)
+/* GW_TRACE: the packet of the next trace record arrives, and the one
+   after it becomes the next ARRIVAL */
+{
+	const TRACE_REC *r = trace_step(&s->trace);
+	int batch = GW_BATCH && r->cls == 1;
+
+	gw_schedule_at(s, gw_span(trace_time(&s->trace)), ARRIVAL);
+	s->total_packets += 1;
+	s->batch_packets += batch;
+	gw_enqueue(s, (int) r->len, batch);
+}
+#endif
+
+static inline void gw_arrival(SIM *s) /* a customer arrives */
+{
+	int i, batch;
+
+	s->narr += 1;                /* keep tally of number of arrivals */
+	s->q_sum += s->q;
+#if GW_TRACE
+	gw_replay(s);
+	return;
+#elif GW_SOURCES
+	batch = gw_source(s);
+#else
+	gw_schedule(s, gw_span(gw_draw(s, &s->arr) * s->iat), ARRIVAL); /* schedule the next arrival */
+	batch = GW_BATCH && (s->batch_interval == 1 || s->narr % s->batch_interval == 0);
+#endif
+	if (batch) {
+		s->total_packets += s->batch_size;
+		s->batch_packets += s->batch_size;
+		for (i = 0; i < s->batch_size; ++i)
+			gw_packet(s, 1);
+		return;
+	}
+	s->total_packets += 1;
+	gw_packet(s, 0);
+}
+
+static inline void gw_departure(SIM *s) /* a customer departs */
+{
+	unsigned x = pktq_front(&s->pktq);
+	int len = s->pktq.pkt_len[x];
+
+	s->q -= 1;
+	s->q_len -= len;
+#if GW_BATCH
+	s->batch_qlen -= s->pktq.batch[x] ? len : 0;
+	GW_LOG(s, EVLOG_DEQ, len, s->pktq.batch[x]);
+#else
+	GW_LOG(s, EVLOG_DEQ, len, 0);
+#endif
+#if GW_STATS & GW_STAT_DELAY
+#if GW_BATCH
+	GW_TIME(s, GW_T_STATS, stat_add(s->pktq.batch[x] ? &s->batch_delay : &s->packet_delay,
+	                                gw_seconds(s->gmt - s->pktq.arrival_time[x])));
+#else
+	GW_TIME(s, GW_T_STATS, stat_add(&s->packet_delay, gw_seconds(s->gmt - s->pktq.arrival_time[x])));
+#endif
+#endif
+	GW_TIME(s, GW_T_PKTQ, pktq_pop(&s->pktq));
+	if (s->q > 0)
+		gw_schedule(s, gw_service(s, s->pktq.pkt_len[pktq_front(&s->pktq)]), DEPARTURE);
+}
+
+/**************************************************************************/
+/* the body of gw_simulate()'s loop, and of the loops of split.h and
+   tilt.h; it has to stay inline in all of them */
+#ifdef __GNUC__
+#define GW_HOT	__attribute__((always_inline))
+#else
+#define GW_HOT
+#endif
+
+static inline GW_HOT int gw_step(SIM *s) /* runs the next event; returns its type */
+{
+	int i, type = gw_act(s);
+
+	switch (type) {
+		case ARRIVAL:
+			GW_COUNT(s, GW_N_ARRIVAL, 1);
+			for (i = 0; i < GW_HOSTS; ++i)
+				gw_arrival(s);
+			break;
+		case DEPARTURE:
+			GW_COUNT(s, GW_N_DEPARTURE, 1);
+			gw_departure(s);
+			break;
+		default:
+			printf("error in act procedure\n");
+			exit(1);
+			break;
+	}
+	return type;
+}
+
+static inline void gw_simulate(SIM *s, long long until) /* runs s until it has seen `until' arrivals */
+{
+#if GW_PROF
+	PROF_TICK t0 = prof_tick();
+#endif
+
+#if GW_TICKS
+	/* twice the expected length of the run must fit on the clock */
+	if (gw_seconds(s->gmt) + 2 * s->iat * (until - s->narr) >= GW_NEVER / GW_TICK_HZ) {
+		fprintf(stderr, "gateway: %lld arrivals run past the clock's %.0f s\n",
+		        until, GW_NEVER / GW_TICK_HZ);
+		exit(1);
+	}
+#endif
+
+	while (s->narr < until)
+		gw_step(s);
+#if GW_PROF
+	s->prof.ticks[GW_T_TOTAL] += prof_tick() - t0;
+#endif
+}
+
+/**************************************************************************/
+static inline void gw_clear(SIM *s)
+/* zeroes the counters and statistics, keeping the clock, the packets in
+   the buffer and the pending events, so that a warmed-up or restored s
+   measures from now on */
+{
+	s->narr = 0;
+	s->nloss = 0;
+	s->batch_nloss = 0;
+	s->q_sum = 0;
+	s->q_peak = s->q_len;
+	s->total_packets = 0;
+	s->batch_packets = 0;
+	stat_reset(&s->batch_delay);
+	stat_reset(&s->packet_delay);
+#if GW_PROF
+	memset(&s->prof, 0, sizeof(s->prof));
+#endif
+}
+
+static inline void gw_derive(SIM *s, int iar)
+/* derives the per-run constants from the configuration and a mean
+   packet arrival rate of iar per second; see gw_start() */
+{
+	s->batch_size = 1;
+	s->batch_interval = 1;
+#if GW_BATCH
+	s->batch_size = s->bar > 0 ? iar / s->bar : 0;
+	s->batch_iat = s->bar > 0 ? 1.0 / s->bar : HUGE_VAL;
+#endif
+#if GW_BATCH && !GW_SOURCES
+	iar = (s->batch_hosts * s->bar) + ((s->hosts - s->batch_hosts) * iar);
+	/* no batch hosts (or rate): no batches */
+	s->batch_interval = s->bar * s->batch_hosts > 0 ? iar / (s->bar * s->batch_hosts) : INT_MAX;
+	if (s->batch_interval < 1)
+		s->batch_interval = 1;
+#endif
+	s->iat = 1.0 / iar;
+	s->byte_time = 8.0 / (s->r_capacity * 1e6);
+#if GW_TICKS
+	s->byte_fix = (long long) (s->byte_time * GW_TICK_HZ * (1 << GW_FIX) + 0.5);
+#endif
+	s->util_octets = s->util_max * 1e6 / (8.0 * s->iat);
+	if (s->hosts > 0) {
+		s->fair_scale[1] = s->discard_z * (s->buffer_size - s->discard_r) / s->hosts;
+		s->fair_scale[0] = s->fair_scale[1] * (s->hosts - s->batch_hosts);
+	}
+}
+
+static inline void gw_fields(SIM *s) /* the packet attributes this build keeps */
+{
+#if GW_BATCH
+	s->pktq.fields |= PKTQ_BATCH;
+#endif
+#if GW_STATS & GW_STAT_DELAY
+	s->pktq.fields |= PKTQ_ARRIVAL;
+#endif
+	(void) s;
+}
+
+static inline void gw_start(SIM *s, int iar)
+/* empties s (keeping its storage), derives the per-run constants from
+   the configuration and a mean packet arrival rate of iar per second,
+   and schedules the first arrival.  With GW_BATCH, iar is the rate of
+   each single-packet host; the batch hosts send bar batches a second
+   of iar/bar packets.  With GW_SOURCES, iar is the rate of each of the
+   hosts (at least one) that do not send batches.  With GW_TRACE, iar is
+   only used for util_octets, and the first arrival is the cursor's. */
+{
+#if GW_SOURCES
+	int h;
+#endif
+
+	expgen_reset(&s->arr);
+	expgen_reset(&s->len);
+	evq_reset(&s->evq);
+	gw_fields(s);
+	pktq_reset(&s->pktq);
+
+	s->gmt = 0;
+	s->q = 0;
+	s->q_len = 0;
+	s->batch_qlen = 0;
+#if GW_TILT
+	s->tilt[0] = s->tilt[1] = 1;
+	s->log_lr = 0;
+	s->tilted = 0;
+#endif
+	gw_clear(s);
+	gw_derive(s, iar);
+#if GW_SOURCES
+	/* every host starts at a random point of its first interval */
+	srcq_reset(&s->src, s->hosts > 0 ? s->hosts : 1);
+	for (h = 0; h < s->src.n; ++h)
+		srcq_fill(&s->src, h, gw_span(gw_draw(s, &s->arr) *
+		          (GW_BATCH && h < s->batch_hosts ? s->batch_iat : s->iat)));
+	srcq_build(&s->src);
+	gw_schedule_at(s, srcq_time(&s->src), ARRIVAL); /* schedule the first arrival */
+#elif GW_TRACE
+	gw_schedule_at(s, gw_span(trace_time(&s->trace)), ARRIVAL);
+#else
+	gw_schedule(s, gw_span(gw_draw(s, &s->arr) * s->iat), ARRIVAL); /* schedule the first arrival */
+#endif
+}
+
+#define GW_STR_(x)	#x
+#define GW_STR(x)	GW_STR_(x)
+
+static inline void gw_prof_dump(SIM *s, FILE *f)
+/* GW_PROF: prints the counters and timers of s since gw_start() as one
+   line of JSON.  ticks.total is all of gw_simulate(); what the phases
+   leave of it is dispatch, admission and the timer reads themselves. */
+{
+#if GW_PROF
+	static const char *const counts[GW_NCOUNTS] = {
+		"arrival_events", "departure_events", "packets", "drops",
+		"evq_walked", "evq_allocs", "pktq_allocs", "pktq_peak" };
+	static const char *const ticks[GW_NTIMERS] = {
+		"evq", "rng", "pktq", "stats", "total" };
+
+	s->prof.count[GW_N_EVQ_WALK] = evq_walked(&s->evq);
+	s->prof.count[GW_N_EVQ_ALLOC] = evq_allocs(&s->evq);
+	flockfile(f);              /* one line even when threads dump at once */
+	fprintf(f, "{\"policy\":\"%s\",\"evq\":\"%s\",\"unit\":\"%s\",\"arrivals\":%lld,",
+	        GW_STR(GW_POLICY), evq_name(&s->evq), PROF_UNIT, s->narr);
+	prof_dump(f, &s->prof, counts, GW_NCOUNTS, ticks, GW_NTIMERS);
+	fprintf(f, "}\n");
+	funlockfile(f);
+#else
+	(void) s;
+	(void) f;
+#endif
+}
+
+#if GW_EVLOG
+static inline void gw_evlog(SIM *s, EVLOG *l)
+/* GW_EVLOG: logs the events of s to l from now on (NULL: stops), with
+   the configuration of s in its header; call after gw_start() */
+{
+	if (l != NULL)
+		evlog_params(l, GW_STR(GW_POLICY), s->buffer_size, s->hosts, s->batch_hosts,
+		             s->discard_r, s->discard_z);
+	s->evlog = l;
+}
+#endif
+
+/**************************************************************************/
+/* snapshots: everything gw_simulate() would carry on from - the clock,
+   counters, statistics, random streams with their buffered variates,
+   configuration, pending events and packets - in a snap.h SNAP.  A
+   snapshot is checked against the build that loads it (policy, flags,
+   event list and SIM layout), and holds nothing outside the SIM: a
+   GW_TRACE cursor points into the trace mapped by this process. */
+
+static inline const char *gw_build(SIM *s, char *buf, size_t n) /* what a snapshot must match */
+{
+	(void) s;                          /* only EVQ_RUNTIME's evq_name() reads it */
+	snprintf(buf, n, "%s batch %d hosts %d sources %d stats %d trace %d ticks %d evq %s sim %lu",
+	         GW_STR(GW_POLICY), GW_BATCH, GW_HOSTS, GW_SOURCES, GW_STATS, GW_TRACE, GW_TICKS,
+	         evq_name(&s->evq), (unsigned long) sizeof(SIM));
+	return buf;
+}
+
+static inline void gw_save(SIM *s, SNAP *sn) /* appends the state of s to sn */
+{
+	char build[128];
+	int n = strlen(gw_build(s, build, sizeof(build))) + 1;
+
+	snap_put(sn, &n, sizeof(int));
+	snap_put(sn, build, n);
+	snap_put(sn, s, sizeof(SIM));      /* the pointers in it are not used */
+	evq_save(&s->evq, sn);
+	pktq_save(&s->pktq, sn);
+	srcq_save(&s->src, sn);
+}
+
+static inline int gw_load(SIM *s, const SNAP *snap)
+/* makes s the SIM saved at the start of snap, keeping its own storage
+   (and GW_EVLOG log); returns 0, or -1 after a message.  A snapshot of
+   another build leaves s as it was; one cut short leaves s part loaded,
+   fit only for gw_free() or gw_start(), since the containers are read
+   into s's own storage rather than copies.  Any number of threads may
+   load one snapshot at once. */
+{
+	SNAP sn = *snap;                   /* a reader of our own */
+	char build[128], saved[128];
+	int n;
+	SIM *t = (SIM *) malloc(sizeof(SIM));
+
+	sn.pos = 0;
+	sn.bad = 0;
+	gw_build(s, build, sizeof(build));
+	if (t == NULL || snap_get(&sn, &n, sizeof(int)) < 0 || n <= 0 || n > (int) sizeof(saved) ||
+	    snap_get(&sn, saved, n) < 0 || saved[n - 1] != '\0' || strcmp(saved, build) != 0 ||
+	    snap_get(&sn, t, sizeof(SIM)) < 0) {
+		fprintf(stderr, "gateway: the snapshot is not of this build (%s)\n", build);
+		free(t);
+		return -1;
+	}
+	/* the saved scalars, with our own containers */
+	t->evq = s->evq;
+	t->pktq = s->pktq;
+	t->src = s->src;
+#if GW_EVLOG
+	t->evlog = s->evlog;
+#endif
+	*s = *t;
+	free(t);
+	gw_fields(s);
+	if (evq_load(&s->evq, &sn) < 0 || pktq_load(&s->pktq, &sn) < 0 ||
+	    srcq_load(&s->src, &sn) < 0) {
+		fprintf(stderr, "gateway: the snapshot is cut short\n");
+		return -1;
+	}
+	return 0;
+}
+
+static inline void gw_free(SIM *s) /* releases the storage held by s */
+{
+	evq_free(&s->evq);
+	pktq_free(&s->pktq);
+	srcq_free(&s->src);
+}
+
+#endif /* GATEWAY_H */
@@ -0,0 +1,263 @@
+/* grid.h - parameter grids for non-interactive sweeps */
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "runner.h"
+
+/* A program lists the parameters it can sweep, each with the value used
+   when it is not swept.  Specs of the form
+
+       name=v1,v2,...      a list of values
+       name=lo:hi:step     lo, lo+step, ... up to hi (items may be mixed)
+
+   set the values of one parameter, given on the command line or one per
+   line of a file ('#' starts a comment).  The points of the grid are all
+   combinations of the values, numbered 0..grid_size()-1 with the last
+   parameter varying fastest.
+
+   grid_sweep() runs every point on the runner.h thread pool and prints
+   one row per point, in point order: the parameters, then the results
+   the program's GRID_FN computed for it.
+
+   A GRID holds its values in malloc'd storage; grid_free() releases it. */
+
+#define GRID_MAX_PARAMS	32
+
+typedef struct{
+	const char *name;
+	double def;                        /* value when not swept */
+	double *v;                         /* values to sweep, or NULL */
+	int n;
+} GRID_PARAM;
+
+typedef struct{
+	GRID_PARAM *param;
+	int nparams;
+} GRID;
+
+/**************************************************************************/
+static inline void grid_add(GRID_PARAM *p, double x) /* appends one value */
+{
+	if ((p->n & (p->n - 1)) == 0) {
+		p->v = (double *) realloc(p->v, (p->n ? 2 * p->n : 1) * sizeof(double));
+		if (p->v == NULL) {
+			fprintf(stderr, "grid: out of memory\n");
+			exit(1);
+		}
+	}
+	p->v[p->n++] = x;
+}
+
+static inline int grid_parse(GRID *g, const char *spec)
+/* reads one name=values spec; returns 0, or -1 after a message on stderr */
+{
+	const char *eq = strchr(spec, '='), *s;
+	char *end;
+	double lo, hi, step, x;
+	GRID_PARAM *p = NULL;
+	int i;
+
+	for (i = 0; eq != NULL && i < g->nparams; ++i)
+		if (strlen(g->param[i].name) == (size_t) (eq - spec) &&
+		    strncmp(g->param[i].name, spec, eq - spec) == 0)
+			p = &g->param[i];
+	if (p == NULL) {
+		fprintf(stderr, "grid: unknown parameter in '%s'\n", spec);
+		return -1;
+	}
+	p->n = 0;
+	for (s = eq + 1; ; s = end + 1) {
+		lo = strtod(s, &end);
+		if (end == s)
+			break;
+		if (*end == ':') {
+			hi = strtod(end + 1, &end);
+			step = *end == ':' ? strtod(end + 1, &end) : 1;
+			if (step <= 0) {
+				fprintf(stderr, "grid: step must be positive in '%s'\n", spec);
+				return -1;
+			}
+			/* the 1e-9 step slack keeps hi when rounding falls short */
+			for (i = 0; (x = lo + i * step) <= hi + 1e-9 * step; ++i)
+				grid_add(p, x);
+		}
+		else
+			grid_add(p, lo);
+		if (*end != ',')
+			break;
+	}
+	if (*end != '\0' && *end != '\n' && *end != ' ' && *end != '\t') {
+		fprintf(stderr, "grid: bad value list in '%s'\n", spec);
+		return -1;
+	}
+	if (p->n == 0) {                   /* nothing, or a range with hi < lo */
+		fprintf(stderr, "grid: no values in '%s'\n", spec);
+		return -1;
+	}
+	return 0;
+}
+
+static inline int grid_read(GRID *g, const char *path)
+/* reads one spec per line of a file; returns 0 or -1 */
+{
+	FILE *f = fopen(path, "r");
+	char line[4096], *s;
+
+	if (f == NULL) {
+		fprintf(stderr, "grid: cannot open %s\n", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((s = strchr(line, '#')) != NULL)
+			*s = '\0';
+		for (s = line; *s == ' ' || *s == '\t'; ++s)
+			;
+		if (*s == '\0' || *s == '\n')
+			continue;
+		if (grid_parse(g, s) < 0) {
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static inline int grid_check(GRID *g, int i, double lo, double hi)
+/* checks the values of parameter i are within lo..hi; returns 0, or -1
+   after a message on stderr */
+{
+	GRID_PARAM *p = &g->param[i];
+	int k;
+
+	for (k = 0; k < p->n; ++k)
+		if (!(p->v[k] >= lo && p->v[k] <= hi)) {
+			fprintf(stderr, "grid: %s must be from %.15g to %.15g, not %g\n",
+			        p->name, lo, hi, p->v[k]);
+			return -1;
+		}
+	return 0;
+}
+
+/**************************************************************************/
+static inline long grid_size(GRID *g) /* number of points */
+{
+	long n = 1;
+	int i;
+
+	for (i = 0; i < g->nparams; ++i)
+		if (g->param[i].n > 0)
+			n *= g->param[i].n;
+	return n;
+}
+
+static inline void grid_point(GRID *g, long k, double *x)
+/* sets x[0..nparams-1] to the parameters of point k */
+{
+	GRID_PARAM *p;
+	int i;
+
+	for (i = g->nparams - 1; i >= 0; --i) {
+		p = &g->param[i];
+		if (p->n > 0) {
+			x[i] = p->v[k % p->n];
+			k /= p->n;
+		}
+		else
+			x[i] = p->def;
+	}
+}
+
+static inline void grid_header(GRID *g, FILE *f) /* prints the parameter names */
+{
+	int i;
+
+	for (i = 0; i < g->nparams; ++i)
+		fprintf(f, "%s%s", i ? " " : "# ", g->param[i].name);
+}
+
+static inline void grid_print(GRID *g, const double *x, FILE *f) /* prints one point */
+{
+	int i;
+
+	for (i = 0; i < g->nparams; ++i)
+		fprintf(f, "%s%g", i ? " " : "", x[i]);
+}
+
+/**************************************************************************/
+/* fn(x, res, worker, arg) runs the point with parameters x and stores
+   its results in res[0..nres-1]; worker is as for RUNNER_JOB */
+typedef void (*GRID_FN)(const double *x, double *res, int worker, void *arg);
+
+typedef struct{
+	GRID *g;
+	GRID_FN fn;
+	void *arg;
+	int nres;
+	double *res;                       /* res[point*nres + k] */
+} GRID_RUN;
+
+static inline void grid_job(int job, int worker, void *p) /* a RUNNER_JOB */
+{
+	GRID_RUN *r = (GRID_RUN *) p;
+	double x[GRID_MAX_PARAMS];
+
+	grid_point(r->g, job, x);
+	r->fn(x, &r->res[(long) job * r->nres], worker, r->arg);
+}
+
+static inline int grid_sweep(GRID *g, int nthreads, const char *columns,
+                             int nres, GRID_FN fn, void *arg, FILE *f)
+/* runs all points and prints a header naming the parameters and then
+   the result columns, and one row per point; returns 0 or -1 */
+{
+	GRID_RUN r;
+	long n = grid_size(g), k;
+	double x[GRID_MAX_PARAMS];
+	int i;
+
+	if (g->nparams > GRID_MAX_PARAMS || n > INT_MAX) {
+		fprintf(stderr, "grid: too many parameters or points\n");
+		return -1;
+	}
+	r.g = g;
+	r.fn = fn;
+	r.arg = arg;
+	r.nres = nres;
+	r.res = (double *) malloc(n * nres * sizeof(double));
+	if (r.res == NULL) {
+		fprintf(stderr, "grid: out of memory\n");
+		exit(1);
+	}
+	runner_run(nthreads, (int) n, grid_job, &r);
+	grid_header(g, f);
+	fprintf(f, " %s\n", columns);
+	for (k = 0; k < n; ++k) {
+		grid_point(g, k, x);
+		grid_print(g, x, f);
+		for (i = 0; i < nres; ++i)
+			fprintf(f, " %.8g", r.res[k * nres + i]);
+		fprintf(f, "\n");
+	}
+	free(r.res);
+	return 0;
+}
+
+static inline void grid_free(GRID *g)
+{
+	int i;
+
+	for (i = 0; i < g->nparams; ++i) {
+		free(g->param[i].v);
+		g->param[i].v = NULL;
+		g->param[i].n = 0;
+	}
+}
+
+#endif /* GRID_H */
@@ -0,0 +1,338 @@
+/* lanes.h - many replications of the single gateway in lockstep */
+
+#ifndef LANES_H
+#define LANES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "expgen.h"
+#include "gateway.h"
+
+#if GW_BATCH || GW_SOURCES || GW_TRACE || GW_HOSTS != 1
+#error "lanes.h runs the plain gateway: one packet per arrival, no batches"
+#endif
+#if GW_TICKS
+#error "lanes.h keeps time in seconds, as gw_simulate() does without GW_TICKS"
+#endif
+
+/* The replications of question1 and question2 run the same small
+   machine on different streams (and buffer sizes): Poisson arrivals to
+   one FIFO server.  Such a queue needs no event list.  A packet admitted
+   at time A with service time S leaves at max(A, D) + S, D the departure
+   of the packet before it, so its departure is known when it arrives;
+   the packets in the system are a ring of (departure, length) pairs, and
+   the next event is either the head's departure or the next arrival.
+
+   A LANESIM advances LANES replications together with every quantity of
+   all the lanes in one GCC vector (a structure of arrays).  At each step
+   a lane retires its head if that has left by the next arrival, and
+   takes the arrival if nothing else has; the two halves are whole-vector
+   operations masked by lane, with no branch on the lanes' states, and a
+   lane that is done or idle is masked out of both.  Only the variates
+   (read straight out of each lane's EXPGEN buffers) and the ring slots
+   are loaded and stored lane by lane.
+
+   The vectors want AVX: build with -march=native (or -mavx2).  LANES
+   defaults to 8 with AVX-512, where a vector is one register, and to 4
+   otherwise; it may be set to 4, 8 or 16 before the include.  Without
+   AVX the vectors are emulated and a lane is slower than gw_simulate().
+
+   A lane is loaded from a SIM just started by gw_start() and takes over
+   its configuration, streams and first arrival.  It draws the same
+   variates in the same order and does the same floating point
+   operations as gw_simulate(), so its narr, nloss and q_sum when it
+   reaches total_events are those run() would have left in the SIM.
+   Admission is gw_admit_util's rule (set util_max above the load for
+   plain drop-tail).
+
+   lanes_alloc() returns zeroed, aligned LANESIMs, all lanes idle;
+   lanes_load() starts a lane, lanes_run() runs until some lane is done,
+   lanes_stop() idles it, and lanes_free() releases the lot. */
+
+#ifndef LANES
+#ifdef __AVX512F__
+#define LANES		8
+#else
+#define LANES		4
+#endif
+#endif
+
+/* f(j, a, b) for each lane j, written out: vectors built element by
+   element would go through memory */
+#if LANES == 4
+#define LANES_EACH(f, a, b)	f(0, a, b) f(1, a, b) f(2, a, b) f(3, a, b)
+#elif LANES == 8
+#define LANES_EACH(f, a, b)	f(0, a, b) f(1, a, b) f(2, a, b) f(3, a, b) \
+				f(4, a, b) f(5, a, b) f(6, a, b) f(7, a, b)
+#elif LANES == 16
+#define LANES_EACH(f, a, b)	f(0, a, b) f(1, a, b) f(2, a, b) f(3, a, b) \
+				f(4, a, b) f(5, a, b) f(6, a, b) f(7, a, b) \
+				f(8, a, b) f(9, a, b) f(10, a, b) f(11, a, b) \
+				f(12, a, b) f(13, a, b) f(14, a, b) f(15, a, b)
+#else
+#error "LANES must be 4, 8 or 16"
+#endif
+#define LANES_NUM(j, a, b)	j,
+#define LANES_AT(j, p, ix)	p[ix[j]],
+#define LANES_PUT(j, d, len)	dep[ix[j]] = d[j]; lens[ix[j]] = len[j];
+
+typedef double LANES_D __attribute__((vector_size(LANES * sizeof(double))));
+typedef long long LANES_I __attribute__((vector_size(LANES * sizeof(long long))));
+
+typedef struct{
+	LANES_D t;                         /* time of the next arrival */
+	LANES_D last;                      /* departure time of the newest packet */
+	LANES_D next;                      /* and of the oldest, HUGE_VAL if none */
+	LANES_I next_len;                  /* the oldest one's length */
+	LANES_D iat, byte_time, mean;      /* configuration, from each lane's SIM */
+	LANES_D util;                      /* util_octets */
+	LANES_I buffer;                    /* buffer_size */
+	LANES_I until;                     /* total_events */
+	LANES_I live;                      /* -1 for a lane in use, 0 idle */
+	LANES_I q, q_len, narr, nloss, q_sum;
+	LANES_I head, tail;                /* packets retired and admitted */
+
+	/* lane l's packets are slots l*cap .. l*cap+cap-1, packet i at
+	   i % cap (a power of 2): departure time and length */
+	double *dep;
+	long long *len;
+	long long cap;
+
+	EXPGEN arr[LANES], lens[LANES];    /* each lane's streams */
+} LANESIM;
+
+/**************************************************************************/
+static inline void lanes_grow(LANESIM *l)
+/* doubles the ring of every lane, keeping each packet's number mod cap */
+{
+	long long cap = l->cap ? 2 * l->cap : 64, i, k;
+	double *dep = (double *) malloc(LANES * cap * sizeof(double));
+	long long *len = (long long *) malloc(LANES * cap * sizeof(long long));
+	int j;
+
+	if (dep == NULL || len == NULL) {
+		fprintf(stderr, "lanes: out of memory\n");
+		exit(1);
+	}
+	for (j = 0; j < LANES; ++j)
+		for (i = l->head[j]; i < l->tail[j]; ++i) {
+			k = j * l->cap + (i & (l->cap - 1));
+			dep[j * cap + (i & (cap - 1))] = l->dep[k];
+			len[j * cap + (i & (cap - 1))] = l->len[k];
+		}
+	free(l->dep);
+	free(l->len);
+	l->dep = dep;
+	l->len = len;
+	l->cap = cap;
+}
+
+static inline LANESIM *lanes_alloc(int n) /* n idle LANESIMs */
+{
+	size_t size = n * sizeof(LANESIM);
+	int i;
+	LANESIM *l = (LANESIM *) aligned_alloc(sizeof(LANES_D),
+	                                       (size + sizeof(LANES_D) - 1) / sizeof(LANES_D) * sizeof(LANES_D));
+
+	if (l == NULL) {
+		fprintf(stderr, "lanes: out of memory\n");
+		exit(1);
+	}
+	memset(l, 0, size);
+	for (i = 0; i < n; ++i)
+		lanes_grow(&l[i]);
+	return l;
+}
+
+static inline void lanes_free(LANESIM *l, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i) {
+		free(l[i].dep);
+		free(l[i].len);
+	}
+	free(l);
+}
+
+/**************************************************************************/
+static inline void lanes_load(LANESIM *l, int j, SIM *s)
+/* starts lane j on s, which gw_start() has just started: its
+   configuration, its streams and its first arrival, which is taken out
+   of s */
+{
+	double t;
+
+	evq_pop(&s->evq, &t);
+	l->t[j] = t;
+	l->last[j] = 0;
+	l->next[j] = HUGE_VAL;
+	l->next_len[j] = 0;
+	l->iat[j] = s->iat;
+	l->byte_time[j] = s->byte_time;
+	l->mean[j] = s->mean_pkt_length;
+	l->util[j] = s->util_octets;
+	l->buffer[j] = s->buffer_size;
+	l->until[j] = s->total_events;
+	l->q[j] = l->q_len[j] = l->narr[j] = l->nloss[j] = l->q_sum[j] = 0;
+	l->head[j] = l->tail[j] = 0;
+	l->arr[j] = s->arr;
+	l->lens[j] = s->len;
+	l->live[j] = -1;
+}
+
+static inline void lanes_stop(LANESIM *l, int j) /* idles lane j */
+{
+	l->live[j] = 0;
+}
+
+/* a in the lanes set in m, b in the others; this and the tests below
+   take no vector by value, which would change the ABI without AVX */
+#define LANES_PICK(m, a, b)	((LANES_D) (((LANES_I) (a) & (m)) | ((LANES_I) (b) & ~(m))))
+
+static inline int lanes_some(const LANES_I *m) /* whether any lane is set in *m */
+{
+	long long r = 0;
+	int j;
+
+	for (j = 0; j < LANES; ++j)
+		r |= (*m)[j];
+	return r != 0;
+}
+
+static inline int lanes_any(const LANES_I *m) /* the first lane set in *m, or -1 */
+{
+	int j;
+
+	for (j = 0; j < LANES; ++j)
+		if ((*m)[j])
+			return j;
+	return -1;
+}
+
+/**************************************************************************/
+static inline int lanes_run(LANESIM *l)
+/* advances every live lane until one of them has seen its total_events
+   arrivals; returns that lane (its counters are then final until it is
+   loaded again), or -1 if no lane is live */
+{
+	/* the state in locals: the ring stores could otherwise alias it,
+	   and every vector would go through memory at each step */
+	LANES_D t = l->t, last = l->last, next = l->next, x, y, d, hd;
+	LANES_I q = l->q, q_len = l->q_len, narr = l->narr, nloss = l->nloss, q_sum = l->q_sum;
+	LANES_I head = l->head, tail = l->tail, live = l->live, next_len = l->next_len;
+	LANES_I m, len, admit, aleft, lleft, dm, am, hl, ix;
+	const LANES_I lane_base = {LANES_EACH(LANES_NUM, , )};
+	const LANES_D iat = l->iat, byte_time = l->byte_time, mean = l->mean, util = l->util;
+	const LANES_I buffer = l->buffer, until = l->until;
+	double *dep = l->dep;
+	long long *lens = l->len, cap = l->cap, mask = cap - 1;
+	int j, done;
+
+	/* the variates are read by index out of the EXPGENs' buffers, with
+	   their 'left' counts in vectors */
+	const double *abuf = l->arr[0].buf, *lbuf = l->lens[0].buf;
+	const long long stride = sizeof(EXPGEN) / sizeof(double);
+
+	for (j = 0; j < LANES; ++j) {
+		aleft[j] = l->arr[j].left;
+		lleft[j] = l->lens[j].left;
+	}
+	for (;;) {
+		m = live & (narr >= until);
+		if (lanes_some(&m)) {
+			done = lanes_any(&m);
+			break;
+		}
+		if (!lanes_some(&live)) {
+			done = -1;
+			break;
+		}
+		/* a departure, in the lanes whose head has left by the next
+		   arrival (ties go to the departure);
+		   the head slot is read in every lane and used in those */
+		dm = live & (next <= t);
+		head -= dm;
+		ix = lane_base * cap + (head & mask);
+		hd = (LANES_D) {LANES_EACH(LANES_AT, dep, ix)};
+		hl = (LANES_I) {LANES_EACH(LANES_AT, lens, ix)};
+		q_len -= next_len & dm;
+		q += dm;
+		m = dm & (head < tail);
+		next = LANES_PICK(m, hd, LANES_PICK(dm, (LANES_D) {} + HUGE_VAL, next));
+		next_len = (hl & m) | (next_len & ~m);
+
+		/* the arrival, as gw_arrival() and gw_enqueue(), in the lanes
+		   with no departure left before it.  Every lane reads a
+		   variate and counts it only then. */
+		am = live & (next > t);
+		m = (aleft == 0) | (lleft == 0);
+		if (lanes_some(&m))
+			for (j = 0; j < LANES; ++j) {
+				if (aleft[j] == 0) {
+					expgen_refill(&l->arr[j]);
+					aleft[j] = EXPGEN_BLOCK;
+				}
+				if (lleft[j] == 0) {
+					expgen_refill(&l->lens[j]);
+					lleft[j] = EXPGEN_BLOCK;
+				}
+			}
+		ix = lane_base * stride + aleft - 1;
+		x = (LANES_D) {LANES_EACH(LANES_AT, abuf, ix)};
+		ix = lane_base * stride + lleft - 1;
+		y = (LANES_D) {LANES_EACH(LANES_AT, lbuf, ix)};
+		aleft += am;
+		lleft += am;
+		narr -= am;
+		q_sum += q & am;
+		len = __builtin_convertvector(y * mean, LANES_I);
+		admit = am & (len + q_len <= buffer) &
+		        (__builtin_convertvector(q_len, LANES_D) <= util);
+		d = LANES_PICK(last > t, last, t) + __builtin_convertvector(len, LANES_D) * byte_time;
+		nloss -= am & ~admit;
+		q -= admit;
+		q_len += len & admit;
+		last = LANES_PICK(admit, d, last);
+		m = admit & (head == tail);        /* into an empty system */
+		next = LANES_PICK(m, d, next);
+		next_len = (len & m) | (next_len & ~m);
+		m = tail - head >= cap;
+		if (lanes_some(&m)) {
+			l->head = head;
+			l->tail = tail;
+			lanes_grow(l);
+			dep = l->dep;
+			lens = l->len;
+			cap = l->cap;
+			mask = cap - 1;
+		}
+		/* the slot past the tail is free in every lane: written in
+		   all, kept in the admitting ones */
+		ix = lane_base * cap + (tail & mask);
+		LANES_EACH(LANES_PUT, d, len)
+		tail -= admit;
+		t = LANES_PICK(am, t + x * iat, t);
+	}
+	l->t = t;
+	l->last = last;
+	l->next = next;
+	l->next_len = next_len;
+	l->q = q;
+	l->q_len = q_len;
+	l->narr = narr;
+	l->nloss = nloss;
+	l->q_sum = q_sum;
+	l->head = head;
+	l->tail = tail;
+	for (j = 0; j < LANES; ++j) {
+		l->arr[j].left = aleft[j];
+		l->lens[j].left = lleft[j];
+	}
+	return done;
+}
+
+#endif /* LANES_H */
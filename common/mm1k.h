@@ -0,0 +1,165 @@
+/* mm1k.h - analytic loss and queue length of the finite-buffer gateway */
+
+#ifndef MM1K_H
+#define MM1K_H
+
+#include <math.h>
+
+/* Steady-state results for a single gateway with Poisson arrivals and
+   negexp packet lengths, in microseconds instead of a simulation:
+
+     mm1k_packets()  the M/M/1/K queue, a buffer of k packets (exact)
+     mm1k_octets()   the gateway.h buffer of B octets, where a packet of
+                     len octets is admitted while q_len + len <= B and
+                     q_len <= util_octets (gw_admit_util/droptail)
+
+   The octet buffer is not a birth-death process in the number of
+   packets n, since admission depends on their lengths.  mm1k_octets()
+   makes it one by taking the n lengths in the buffer as independent
+   negexp, so that n grows at rate lambda*a(n) with
+
+       a(n) = P(S_n <= m, S_n + X <= B)   S_n ~ Erlang(n), m = min(U, B)
+            = P(n, m/L) - exp(-B/L) (m/L)^n / n!
+
+   (P the regularised incomplete gamma function, L the mean length), and
+   falls at rate mu.  In fact the packets in a busy buffer are shorter
+   than that, since it is the long ones that get dropped, so the loss
+   comes out high: two to three times the simulated steady-state loss
+   around 0.001, and a buffer some 10-20% too large.  That makes it a
+   safe first answer and a close upper starting point for a simulated
+   search.
+
+   The mean length is that of (int) (negexp() * mean_pkt_length), as
+   gw_packet() draws it, 1/(exp(1/mean)-1), about mean - 0.5.
+
+   Results are per arriving packet (PASTA): the loss probability, the
+   mean number in the system an arrival sees (the q column of the
+   simulators), and the mean time an admitted packet spends there. */
+
+#define MM1K_TAIL	40.0	/* stop once the weights fall e^40 below the peak */
+#define MM1K_MAX_STATES	100000000L
+
+typedef struct{
+	double loss;                       /* probability a packet is dropped */
+	double qlen;                       /* mean number in system seen by arrivals */
+	double delay;                      /* mean time in system of admitted packets */
+	long states;                       /* states summed */
+} MM1K;
+
+/**************************************************************************/
+static inline double mm1k_mean_len(double mean_pkt_length)
+/* mean of (int) (negexp() * mean_pkt_length) */
+{
+	return 1.0 / expm1(1.0 / mean_pkt_length);
+}
+
+/* running sums over the states, relative to the largest weight so far */
+typedef struct{
+	double top;                        /* log of that weight */
+	double w, wn, wl;                  /* sum of weights, of n*weight, of loss*weight */
+} MM1K_SUM;
+
+static inline void mm1k_add(MM1K_SUM *u, long n, double la, double a)
+/* adds state n, of log weight la and admission probability a */
+{
+	double w;
+
+	if (la > u->top) {
+		w = exp(u->top - la);
+		u->w *= w;
+		u->wn *= w;
+		u->wl *= w;
+		u->top = la;
+	}
+	w = exp(la - u->top);
+	u->w += w;
+	u->wn += n * w;
+	u->wl += (1.0 - a) * w;
+}
+
+static inline void mm1k_finish(MM1K *r, const MM1K_SUM *u, double lambda, long states)
+{
+	r->loss = u->wl / u->w;
+	r->qlen = u->wn / u->w;
+	/* Little: admitted packets arrive at lambda*(1-loss) */
+	r->delay = r->loss < 1.0 ? r->qlen / (lambda * (1.0 - r->loss)) : HUGE_VAL;
+	r->states = states;
+}
+
+/**************************************************************************/
+static inline void mm1k_packets(MM1K *r, double lambda, double mu, long k)
+/* M/M/1/K: at most k >= 1 packets in the system, including the one in
+   service */
+{
+	MM1K_SUM u = {0};
+	double la = 0, lr = log(lambda / mu);
+	long n;
+
+	for (n = 0; n <= k; ++n) {
+		mm1k_add(&u, n, la, n < k);
+		la += lr;
+	}
+	mm1k_finish(r, &u, lambda, k + 1);
+}
+
+static inline void mm1k_octets(MM1K *r, double lambda, double mean_pkt_length,
+                               double byte_time, double buffer, double util_octets)
+/* the gateway.h buffer of 'buffer' octets at lambda packets a second and
+   byte_time seconds an octet */
+{
+	double len = mm1k_mean_len(mean_pkt_length);
+	double m = util_octets < buffer ? util_octets : buffer;
+	double x = m / len;                /* the Poisson mean in P(n, x) */
+	double cut = exp((m - buffer) / len);
+	double lr = log(lambda * len * byte_time);
+	double p = 1.0;                    /* P(n, x) */
+	double t, a, la = 0;
+	MM1K_SUM u = {0};
+	long n;
+
+	for (n = 0; n < MM1K_MAX_STATES; ++n) {
+		/* t = exp(-x) x^n / n!, the term that P(n+1, x) loses */
+		t = x > 0 ? exp(n * log(x) - x - lgamma(n + 1.0)) : (n == 0);
+		a = p - t * cut;
+		if (a < 0)
+			a = 0;
+		mm1k_add(&u, n, la, a);
+		/* a(n) only falls, so once the weights do they keep falling */
+		if (a == 0 || (la < u.top - MM1K_TAIL && lr + log(a) < 0))
+			break;
+		la += lr + log(a);
+		p -= t;
+	}
+	mm1k_finish(r, &u, lambda, n + 1);
+}
+
+static inline long mm1k_buffer(double lambda, double mean_pkt_length, double byte_time,
+                               double util_octets, double target, long unit, long max)
+/* the smallest buffer, in units of 'unit' octets and at most max units,
+   whose mm1k_octets() loss is at most target; max + 1 if there is none */
+{
+	MM1K r;
+	long lo = 0, hi = 1;
+
+	/* the loss falls as the buffer grows: gallop, then bisect */
+	for (;;) {
+		mm1k_octets(&r, lambda, mean_pkt_length, byte_time, (double) hi * unit, util_octets);
+		if (r.loss <= target)
+			break;
+		if (hi >= max)
+			return max + 1;
+		lo = hi;
+		hi = 2 * hi < max ? 2 * hi : max;
+	}
+	while (hi - lo > 1) {
+		mm1k_octets(&r, lambda, mean_pkt_length, byte_time,
+		            (double) (lo + (hi - lo) / 2) * unit, util_octets);
+		if (r.loss <= target)
+			hi = lo + (hi - lo) / 2;
+		else
+			lo = lo + (hi - lo) / 2;
+	}
+	return hi;
+}
+
+#endif /* MM1K_H */
@@ -0,0 +1,445 @@
+/* net.h - networks of gateways as a conservative parallel simulation */
+
+#ifndef NET_H
+#define NET_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+/* Every node of the network is one gateway.h gateway, simulated as a
+   logical process (LP) with its own SIM, random streams and clock.  A
+   packet leaving a node either leaves the network or is sent down one
+   of the node's links, chosen with the links' probabilities, and enters
+   the next node 'delay' seconds later with its length unchanged.  Nodes
+   may also have external Poisson arrivals.
+
+   The nodes are split into contiguous blocks, one per thread, and the
+   links are lock-free SPSC rings (spsc.h), so a node never waits on a
+   lock.  Synchronisation is conservative (Chandy-Misra-Bryant): a node
+   only handles an event once no link can still bring an earlier one.
+   Messages on a link have non-decreasing times, so a link's latest
+   time bounds what it can bring next.  To keep the others moving a node
+   sends null messages promising that nothing will come before
+
+       (departure time of the packet in service, or the node's own
+        earliest possible event when it is idle) + link delay
+
+   which is the lookahead of the service time and the link delay; every
+   delay must be positive.  Ties are broken by time, then messages before
+   the node's own events, then by link number, so results do not depend
+   on the number of threads or how they interleave.
+
+   A packet's buffer arrival_time is the time it entered the network, so
+   a node's packet_delay is the time its departing packets have spent in
+   the network so far, and exit_delay that of those leaving it.
+
+   The program defines the gateway.h options (GW_STATS must include
+   GW_STAT_DELAY, the default here; GW_BATCH and GW_SOURCES are not
+   supported) and includes this file instead of gateway.h.  Build with
+   -pthread. */
+
+#ifndef GW_STATS
+#define GW_STATS	GW_STAT_DELAY
+#endif
+
+#include "gateway.h"
+#include "rng.h"
+#include "spsc.h"
+
+#if !(GW_STATS & GW_STAT_DELAY) || GW_BATCH || GW_SOURCES
+#error "net.h needs GW_STAT_DELAY and single packets from one source per node"
+#endif
+#if GW_TICKS
+#error "net.h passes times between nodes in seconds; build without GW_TICKS"
+#endif
+
+#define NET_RING	4096        /* messages a link can hold */
+#define NET_BUDGET	256         /* events a node handles per turn */
+
+typedef struct{
+	double time;                       /* when the packet enters the next node */
+	double born;                       /* when it entered the network */
+	int len;                           /* octets, or -1 for a null message */
+} NET_MSG;
+
+typedef struct{
+	SPSC ring;                         /* NET_MSGs from 'from' to 'to' */
+	int from, to;
+	double prob;                       /* share of from's departures sent here */
+	double delay;                      /* propagation delay, > 0 */
+	/* producer's */
+	double sent;                       /* latest time sent */
+	long nulls;                        /* null messages sent */
+	char pad[SPSC_LINE];
+	/* consumer's */
+	double clock;                      /* latest time received */
+} NET_LINK;
+
+typedef struct{
+	SIM s;                             /* the gateway */
+	int ext_rate;                      /* external arrivals a second, or 0 */
+	int *in, nin;                      /* links into the node */
+	int *out, nout;                    /* and out of it */
+
+	/* state of a run */
+	double next;                       /* the earliest own event, taken from s.evq */
+	int type;                          /* and its type */
+	int held;                          /* whether next/type hold one */
+	double dep;                        /* departure time of the packet in service */
+	int done;                          /* all events before the end handled */
+	int closed;                        /* and every link told so */
+	long received;                     /* packets from other nodes */
+	long exits;                        /* packets that left the network here */
+	long events;                       /* events handled */
+	STAT exit_delay;                   /* time in the network of those */
+} NET_NODE;
+
+typedef struct{
+	NET_NODE *node;
+	int nnodes, node_cap;
+	NET_LINK *link;
+	int nlinks, link_cap;
+	double end;                        /* simulated seconds */
+	long seed;
+	atomic_int left;                   /* nodes not yet closed */
+} NET;
+
+typedef struct{
+	NET *n;
+	int lo, hi;                        /* the thread's nodes */
+} NET_PART;
+
+/**************************************************************************/
+static inline void *net_grow(void *a, int *cap, size_t size)
+{
+	*cap = *cap ? 2 * *cap : 16;
+	a = realloc(a, *cap * size);
+	if (a == NULL) {
+		fprintf(stderr, "net: out of memory\n");
+		exit(1);
+	}
+	return a;
+}
+
+static inline int net_add_node(NET *n, int ext_rate, int buffer_size,
+                               int r_capacity, int mean_pkt_length)
+/* adds a gateway and returns its number */
+{
+	NET_NODE *v;
+
+	if (n->nnodes == n->node_cap)
+		n->node = (NET_NODE *) net_grow(n->node, &n->node_cap, sizeof(NET_NODE));
+	v = &n->node[n->nnodes];
+	memset(v, 0, sizeof(*v));
+	v->ext_rate = ext_rate;
+	v->s.buffer_size = buffer_size;
+	v->s.r_capacity = r_capacity;
+	v->s.mean_pkt_length = mean_pkt_length;
+	return n->nnodes++;
+}
+
+static inline int net_add_link(NET *n, int from, int to, double prob, double delay)
+/* adds a link; returns its number, or -1 after a message on stderr */
+{
+	NET_LINK *l;
+
+	if (from < 0 || from >= n->nnodes || to < 0 || to >= n->nnodes ||
+	    !(delay > 0) || prob < 0) {
+		fprintf(stderr, "net: bad link %d -> %d (delay must be > 0)\n", from, to);
+		return -1;
+	}
+	if (n->nlinks == n->link_cap)
+		n->link = (NET_LINK *) net_grow(n->link, &n->link_cap, sizeof(NET_LINK));
+	l = &n->link[n->nlinks];
+	memset(l, 0, sizeof(*l));
+	l->from = from;
+	l->to = to;
+	l->prob = prob;
+	l->delay = delay;
+	return n->nlinks++;
+}
+
+/**************************************************************************/
+static inline void net_send(NET *n, NET_NODE *v, double born, int len)
+/* the packet that just left v goes down a link or out of the network */
+{
+	double u = erand48(v->s.rng);
+	NET_LINK *l;
+	NET_MSG m;
+	int i;
+
+	for (i = 0; i < v->nout; ++i) {
+		l = &n->link[v->out[i]];
+		if (u < l->prob) {
+			m.time = v->s.gmt + l->delay;
+			m.born = born;
+			m.len = len;
+			/* nothing at or after the end is needed downstream */
+			if (m.time < n->end) {
+				spsc_push(&l->ring, &m);
+				l->sent = m.time;
+			}
+			return;
+		}
+		u -= l->prob;
+	}
+	v->exits++;
+	stat_add(&v->exit_delay, v->s.gmt - born);
+}
+
+static inline int net_advance(NET *n, NET_NODE *v)
+/* handles up to NET_BUDGET events of v that no link can still precede;
+   returns the number handled */
+{
+	SIM *s = &v->s;
+	NET_LINK *l, *from;
+	NET_MSG *m, *msg;
+	double t, safe, born;
+	int i, k, len, slot, q0, type;
+
+	for (k = 0; k < NET_BUDGET; ++k) {
+		if (!v->held) {
+			v->type = evq_pop(&s->evq, &v->next);
+			v->held = 1;
+			/* gw_start() schedules an ARRIVAL even for a node without
+			   external traffic; it never comes */
+			if (v->type == ARRIVAL && v->ext_rate <= 0)
+				v->next = HUGE_VAL;
+		}
+
+		/* the earliest message, and how far the idle links let us go */
+		t = v->next;
+		from = NULL;
+		msg = NULL;
+		safe = HUGE_VAL;
+		for (i = 0; i < v->nin; ++i) {
+			l = &n->link[v->in[i]];
+			while ((m = (NET_MSG *) spsc_peek(&l->ring)) != NULL && m->len < 0) {
+				l->clock = m->time;
+				spsc_pop(&l->ring);
+			}
+			if (m == NULL)
+				safe = l->clock < safe ? l->clock : safe;
+			else if (m->time < t || (m->time == t && msg == NULL)) {
+				t = m->time;
+				from = l;
+				msg = m;
+			}
+		}
+		if (t >= n->end) {
+			v->done = safe >= n->end;
+			break;
+		}
+		if (t >= safe)
+			break;
+
+		q0 = s->q;
+		if (msg != NULL) {
+			/* a packet from another node; the held event may no longer
+			   be the earliest of s once this one is in */
+			from->clock = t;
+			born = msg->born;
+			len = msg->len;
+			spsc_pop(&from->ring);
+			evq_push(&s->evq, v->next, v->type);
+			v->held = 0;
+			s->gmt = t;
+			slot = gw_enqueue(s, len, 0);
+			if (slot >= 0)
+				s->pktq.arrival_time[slot] = born;
+			v->received++;
+			type = ARRIVAL;
+		}
+		else if ((type = v->type) == ARRIVAL) {
+			v->held = 0;
+			s->gmt = t;
+			gw_arrival(s);
+		}
+		else {
+			/* wait for room on every link the packet might take, but
+			   not on one it would reach at or after the end: net_send()
+			   drops it, and a closed node no longer drains its links */
+			for (i = 0; i < v->nout; ++i) {
+				l = &n->link[v->out[i]];
+				if (t + l->delay < n->end && spsc_room(&l->ring) == 0)
+					return k;
+			}
+			v->held = 0;
+			s->gmt = t;
+			slot = pktq_front(&s->pktq);
+			born = s->pktq.arrival_time[slot];
+			len = s->pktq.pkt_len[slot];
+			gw_departure(s);
+			net_send(n, v, born, len);
+		}
+		/* as gw_packet()/gw_departure() schedule it */
+		if (s->q > 0 && (type == DEPARTURE || q0 == 0))
+			v->dep = s->gmt + s->pktq.pkt_len[pktq_front(&s->pktq)] * s->byte_time;
+		v->events++;
+	}
+	return k;
+}
+
+static inline void net_promise(NET *n, NET_NODE *v)
+/* sends each link a null message with the earliest time it can still
+   bring, if that has moved on; closes v once every link has been told
+   that nothing more comes before the end */
+{
+	NET_LINK *l;
+	NET_MSG m, *head;
+	double lb = v->next, t;
+	int i, open = 0;
+
+	/* idle: nothing leaves before the next arrival, own or from a link */
+	for (i = 0; i < v->nin; ++i) {
+		l = &n->link[v->in[i]];
+		head = (NET_MSG *) spsc_peek(&l->ring);
+		t = head != NULL ? head->time : l->clock;
+		lb = t < lb ? t : lb;
+	}
+	if (v->done)
+		lb = HUGE_VAL;
+	else if (v->s.q > 0)
+		lb = v->dep;
+	for (i = 0; i < v->nout; ++i) {
+		l = &n->link[v->out[i]];
+		m.time = lb + l->delay;
+		m.born = 0;
+		m.len = -1;
+		/* once a link has promised the end it has nothing more to say */
+		if (l->sent < n->end && m.time > l->sent && spsc_push(&l->ring, &m)) {
+			l->sent = m.time;
+			l->nulls++;
+		}
+		open += l->sent < n->end;
+	}
+	if (v->done && !open) {
+		v->closed = 1;
+		atomic_fetch_sub(&n->left, 1);
+	}
+}
+
+static inline void *net_thread(void *p) /* runs one block of nodes to the end */
+{
+	NET_PART *w = (NET_PART *) p;
+	NET *n = w->n;
+	NET_NODE *v;
+	int i, work;
+
+	while (atomic_load(&n->left) > 0) {
+		work = 0;
+		for (i = w->lo; i < w->hi; ++i) {
+			v = &n->node[i];
+			if (v->closed)
+				continue;
+			if (!v->done)
+				work += net_advance(n, v);
+			net_promise(n, v);
+		}
+		if (work == 0)
+			sched_yield();
+	}
+	return NULL;
+}
+
+/**************************************************************************/
+static inline void net_run(NET *n, int nthreads)
+/* simulates the network from empty for n->end seconds on nthreads
+   threads; the results are in the nodes' SIMs and counters */
+{
+	NET_PART *part;
+	pthread_t *tid;
+	NET_NODE *v;
+	NET_LINK *l;
+	int i, per;
+
+	if (nthreads > n->nnodes)
+		nthreads = n->nnodes;
+	if (nthreads < 1)
+		nthreads = 1;
+	for (i = 0; i < n->nnodes; ++i) {
+		v = &n->node[i];
+		free(v->in);
+		free(v->out);
+		v->in = (int *) calloc(n->nlinks + 1, sizeof(int));
+		v->out = (int *) calloc(n->nlinks + 1, sizeof(int));
+		if (v->in == NULL || v->out == NULL) {
+			fprintf(stderr, "net: out of memory\n");
+			exit(1);
+		}
+		v->nin = v->nout = 0;
+	}
+	for (i = 0; i < n->nlinks; ++i) {
+		l = &n->link[i];
+		if (l->ring.item == NULL)
+			spsc_init(&l->ring, NET_RING, sizeof(NET_MSG));
+		l->sent = l->clock = 0;
+		l->nulls = 0;
+		n->node[l->from].out[n->node[l->from].nout++] = i;
+		n->node[l->to].in[n->node[l->to].nin++] = i;
+	}
+	for (i = 0; i < n->nnodes; ++i) {
+		v = &n->node[i];
+		rng_seed(v->s.rng, n->seed, (long) i * RNG_SUBSTREAMS);
+		rng_seed(v->s.arr.rng, n->seed, (long) i * RNG_SUBSTREAMS + 1);
+		rng_seed(v->s.len.rng, n->seed, (long) i * RNG_SUBSTREAMS + 2);
+		gw_start(&v->s, v->ext_rate);
+		v->held = v->done = v->closed = 0;
+		v->dep = HUGE_VAL;
+		v->received = v->exits = v->events = 0;
+		stat_reset(&v->exit_delay);
+	}
+	atomic_store(&n->left, n->nnodes);
+
+	part = (NET_PART *) malloc(nthreads * sizeof(NET_PART));
+	tid = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+	if (part == NULL || tid == NULL) {
+		fprintf(stderr, "net: out of memory\n");
+		exit(1);
+	}
+	per = n->nnodes / nthreads;
+	for (i = 0; i < nthreads; ++i) {
+		part[i].n = n;
+		part[i].lo = i * per + (i < n->nnodes % nthreads ? i : n->nnodes % nthreads);
+		part[i].hi = part[i].lo + per + (i < n->nnodes % nthreads);
+	}
+	/* the calling thread runs the last block; a node never blocks its
+	   thread, so if a thread cannot start it also takes that block and
+	   the ones after it */
+	for (i = 0; i < nthreads - 1; ++i)
+		if (pthread_create(&tid[i], NULL, net_thread, &part[i]) != 0) {
+			fprintf(stderr, "net: cannot start thread %d, running %d blocks on the calling thread\n",
+				i, nthreads - i);
+			part[nthreads - 1].lo = part[i].lo;
+			break;
+		}
+	net_thread(&part[nthreads - 1]);
+	while (--i >= 0)
+		pthread_join(tid[i], NULL);
+	free(part);
+	free(tid);
+}
+
+static inline void net_free(NET *n)
+{
+	int i;
+
+	for (i = 0; i < n->nnodes; ++i) {
+		gw_free(&n->node[i].s);
+		free(n->node[i].in);
+		free(n->node[i].out);
+	}
+	for (i = 0; i < n->nlinks; ++i)
+		spsc_free(&n->link[i].ring);
+	free(n->node);
+	free(n->link);
+	n->node = NULL;
+	n->link = NULL;
+	n->nnodes = n->node_cap = n->nlinks = n->link_cap = 0;
+}
+
+#endif /* NET_H */
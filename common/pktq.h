@@ -0,0 +1,162 @@
+/* pktq.h - FIFO packet buffer of the gateway */
+
+#ifndef PKTQ_H
+#define PKTQ_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snap.h"
+
+/* The packets waiting in (or being served by) the gateway, oldest first,
+   kept in a ring buffer with one array per packet attribute.  Enqueue
+   and dequeue are O(1); when the ring is full its capacity doubles.
+
+   Only pkt_len is always present.  A simulation that needs the arrival
+   time or the batch flag of each packet sets PKTQ_ARRIVAL and/or
+   PKTQ_BATCH in 'fields' before the first pktq_push().
+
+   pktq_save() and pktq_load() put the packets in a snap.h snapshot and
+   back, oldest first.
+
+   Arrival times are doubles unless PKTQ_TIME names another arithmetic
+   type before the include (as gateway.h's GW_TICKS does).
+
+   A zero-initialised PKTQ is a valid empty buffer. */
+
+#define PKTQ_ARRIVAL	1
+#define PKTQ_BATCH	2
+
+#ifndef PKTQ_TIME
+#define PKTQ_TIME	double
+#endif
+
+typedef struct{
+	int *pkt_len;                      /* Length of packet */
+	PKTQ_TIME *arrival_time;           /* time that the packet arrived in the system */
+	char *batch;                       /* whether the packet is part of a batch arrival */
+	int fields;                        /* PKTQ_ARRIVAL | PKTQ_BATCH */
+	unsigned head;                     /* slot of the oldest packet */
+	unsigned count;                    /* number of packets held */
+	unsigned cap;                      /* number of slots, a power of two */
+} PKTQ;
+
+/**************************************************************************/
+static inline void *pktq_regrow(void *old, unsigned head, unsigned count,
+                                unsigned cap, unsigned newcap, size_t size)
+/* copies the ring 'old' into a new array, oldest packet first */
+{
+	char *a = (char *) malloc(newcap * size);
+	unsigned first = cap - head < count ? cap - head : count;
+
+	if (a == NULL) {
+		fprintf(stderr, "pktq: out of memory\n");
+		exit(1);
+	}
+	if (count > 0) {
+		memcpy(a, (char *) old + head * size, first * size);
+		memcpy(a + first * size, old, (count - first) * size);
+	}
+	free(old);
+	return a;
+}
+
+static inline void pktq_grow(PKTQ *q)
+{
+	unsigned newcap = q->cap ? 2 * q->cap : 64;
+
+	q->pkt_len = (int *) pktq_regrow(q->pkt_len, q->head, q->count,
+	                                 q->cap, newcap, sizeof(int));
+	if (q->fields & PKTQ_ARRIVAL)
+		q->arrival_time = (PKTQ_TIME *) pktq_regrow(q->arrival_time, q->head,
+		                          q->count, q->cap, newcap, sizeof(PKTQ_TIME));
+	if (q->fields & PKTQ_BATCH)
+		q->batch = (char *) pktq_regrow(q->batch, q->head, q->count,
+		                                q->cap, newcap, sizeof(char));
+	q->head = 0;
+	q->cap = newcap;
+}
+
+/**************************************************************************/
+static inline unsigned pktq_push(PKTQ *q, int pkt_len)
+/* appends a packet and returns its slot, for filling in the optional
+   attributes */
+{
+	unsigned slot;
+
+	if (q->count == q->cap)
+		pktq_grow(q);
+	slot = (q->head + q->count++) & (q->cap - 1);
+	q->pkt_len[slot] = pkt_len;
+	return slot;
+}
+
+static inline unsigned pktq_front(PKTQ *q) /* slot of the oldest packet */
+{
+	return q->head;
+}
+
+static inline void pktq_pop(PKTQ *q) /* removes the oldest packet */
+{
+	q->head = (q->head + 1) & (q->cap - 1);
+	q->count--;
+}
+
+static inline void pktq_reset(PKTQ *q) /* empties the buffer, keeping its storage */
+{
+	q->head = 0;
+	q->count = 0;
+}
+
+static inline void pktq_free(PKTQ *q)
+{
+	free(q->pkt_len);
+	free(q->arrival_time);
+	free(q->batch);
+	q->pkt_len = NULL;
+	q->arrival_time = NULL;
+	q->batch = NULL;
+	q->head = q->count = q->cap = 0;
+}
+
+static inline void pktq_save(PKTQ *q, SNAP *sn)
+{
+	unsigned i, x;
+
+	snap_put(sn, &q->fields, sizeof(int));
+	snap_put(sn, &q->count, sizeof(unsigned));
+	for (i = 0; i < q->count; ++i) {
+		x = (q->head + i) & (q->cap - 1);
+		snap_put(sn, &q->pkt_len[x], sizeof(int));
+		if (q->fields & PKTQ_ARRIVAL)
+			snap_put(sn, &q->arrival_time[x], sizeof(PKTQ_TIME));
+		if (q->fields & PKTQ_BATCH)
+			snap_put(sn, &q->batch[x], sizeof(char));
+	}
+}
+
+static inline int pktq_load(PKTQ *q, SNAP *sn)
+/* empties q and appends the packets pktq_save() saved; returns 0, or -1
+   if the snapshot ran out or has attributes q lacks */
+{
+	unsigned i, n, x;
+	int fields, len;
+
+	pktq_reset(q);
+	if (snap_get(sn, &fields, sizeof(int)) < 0 || (fields & ~q->fields) != 0 ||
+	    snap_get(sn, &n, sizeof(unsigned)) < 0)
+		return -1;
+	for (i = 0; i < n; ++i) {
+		if (snap_get(sn, &len, sizeof(int)) < 0)
+			return -1;
+		x = pktq_push(q, len);
+		if (fields & PKTQ_ARRIVAL)
+			snap_get(sn, &q->arrival_time[x], sizeof(PKTQ_TIME));
+		if (fields & PKTQ_BATCH)
+			snap_get(sn, &q->batch[x], sizeof(char));
+	}
+	return sn->bad ? -1 : 0;
+}
+
+#endif /* PKTQ_H */
@@ -0,0 +1,124 @@
+/* pool.h - fixed-size node allocator for the simulators' linked lists */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Nodes are carved from chunks of POOL_CHUNK_NODES nodes and recycled
+   through a free list, so a running simulation only calls malloc when
+   its pending set reaches a new high-water mark.  pool_reset() hands
+   every node back in O(1) while keeping the chunks for the next
+   replication; pool_free() returns the chunks to the system.
+
+   All nodes of one pool have the same size, fixed by the first
+   pool_alloc().  A zero-initialised POOL is a valid empty pool. */
+
+#define POOL_CHUNK_NODES	1024
+
+typedef struct pool_chunk{
+	struct pool_chunk *next;           /* next chunk, in allocation order */
+	double data[1];                    /* nodes start here, suitably aligned */
+} POOL_CHUNK;
+
+typedef struct pool_node{
+	struct pool_node *next;
+} POOL_NODE;
+
+typedef struct{
+	size_t size;                       /* node size in bytes */
+	POOL_NODE *freelist;               /* nodes returned by pool_put() */
+	POOL_CHUNK *first;                 /* all chunks, oldest first */
+	POOL_CHUNK *cur;                   /* chunk being carved */
+	char *next, *end;                  /* unused part of cur */
+	int nchunks;                       /* chunks obtained from malloc */
+} POOL;
+
+/**************************************************************************/
+static inline void pool_carve(POOL *p, POOL_CHUNK *c)
+/* makes c the chunk that new nodes are taken from */
+{
+	p->cur = c;
+	p->next = (char *) c->data;
+	p->end = p->next + POOL_CHUNK_NODES * p->size;
+}
+
+static inline void *pool_refill(POOL *p, size_t size)
+/* slow path of pool_alloc(): the current chunk is used up */
+{
+	POOL_CHUNK *c;
+
+	if (p->size == 0) {
+		p->size = (size + sizeof(double) - 1) / sizeof(double) * sizeof(double);
+		if (p->size < sizeof(POOL_NODE))
+			p->size = sizeof(POOL_NODE);
+	}
+	if (p->cur != NULL && p->cur->next != NULL) {
+		/* reuse a chunk kept by pool_reset() */
+		pool_carve(p, p->cur->next);
+	}
+	else {
+		c = (POOL_CHUNK *) malloc(sizeof(POOL_CHUNK) + POOL_CHUNK_NODES * p->size);
+		if (c == NULL) {
+			fprintf(stderr, "pool: out of memory\n");
+			exit(1);
+		}
+		c->next = NULL;
+		if (p->cur != NULL)
+			p->cur->next = c;
+		else
+			p->first = c;
+		p->nchunks++;
+		pool_carve(p, c);
+	}
+	p->next += p->size;
+	return p->next - p->size;
+}
+
+static inline void *pool_alloc(POOL *p, size_t size) /* returns one node */
+{
+	POOL_NODE *x = p->freelist;
+
+	if (x != NULL) {
+		p->freelist = x->next;
+		return x;
+	}
+	if (p->next < p->end) {
+		p->next += p->size;
+		return p->next - p->size;
+	}
+	return pool_refill(p, size);
+}
+
+static inline void pool_put(POOL *p, void *node) /* gives one node back */
+{
+	POOL_NODE *x = (POOL_NODE *) node;
+
+	x->next = p->freelist;
+	p->freelist = x;
+}
+
+/**************************************************************************/
+static inline void pool_reset(POOL *p) /* gives every node back at once */
+{
+	p->freelist = NULL;
+	if (p->first != NULL)
+		pool_carve(p, p->first);
+}
+
+static inline void pool_free(POOL *p)
+{
+	POOL_CHUNK *c, *next;
+
+	for (c = p->first; c != NULL; c = next) {
+		next = c->next;
+		free(c);
+	}
+	p->freelist = NULL;
+	p->first = p->cur = NULL;
+	p->next = p->end = NULL;
+	p->nchunks = 0;
+}
+
+#endif /* POOL_H */
@@ -0,0 +1,78 @@
+/* prof.h - counters and cycle-counter timers for instrumented builds */
+
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* A PROF holds up to PROF_MAX event counters and PROF_MAX phase timers
+   for one simulation.  The owner numbers them and names them only when
+   they are printed, so a counter is one add and a timer two reads of the
+   time-stamp counter (clock_gettime() nanoseconds where there is none)
+   around the code it measures.  The reads themselves cost some tens of
+   cycles, so timers suit phases of a few hundred cycles or more in
+   aggregate, and are meant for finding where the time goes rather than
+   for absolute numbers; bench/ has the clean timings.
+
+   prof_dump() prints the counters and timers as the members "counts"
+   and "ticks" of a JSON object that the caller opens and closes.
+
+   A zero-initialised PROF is valid and empty. */
+
+#define PROF_MAX	16
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PROF_UNIT	"cycles"
+#else
+#define PROF_UNIT	"ns"
+#endif
+
+typedef unsigned long long PROF_TICK;
+
+typedef struct{
+	unsigned long long count[PROF_MAX];  /* events */
+	PROF_TICK ticks[PROF_MAX];           /* time in PROF_UNIT per phase */
+} PROF;
+
+/**************************************************************************/
+static inline PROF_TICK prof_tick(void) /* the time-stamp counter, or ns */
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (PROF_TICK) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static inline void prof_members(FILE *f, const char *what,
+                                 const unsigned long long *v,
+                                 const char *const *names, int n)
+/* prints "what":{"name":v,...} */
+{
+	int i;
+
+	fprintf(f, "\"%s\":{", what);
+	for (i = 0; i < n; ++i)
+		fprintf(f, "%s\"%s\":%llu", i ? "," : "", names[i], v[i]);
+	fprintf(f, "}");
+}
+
+static inline void prof_dump(FILE *f, const PROF *p,
+                             const char *const *counts, int ncounts,
+                             const char *const *ticks, int nticks)
+/* prints "counts":{...},"ticks":{...} for the first ncounts counters and
+   nticks timers, named by counts[] and ticks[] */
+{
+	prof_members(f, "counts", p->count, counts, ncounts);
+	fprintf(f, ",");
+	prof_members(f, "ticks", p->ticks, ticks, nticks);
+}
+
+#endif /* PROF_H */
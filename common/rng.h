@@ -0,0 +1,36 @@
+/* rng.h - seeding of per-simulation random number streams */
+
+#ifndef RNG_H
+#define RNG_H
+
+/* Every simulation draws from its own erand48() state.  rng_seed()
+   fills that state from a (seed, stream) pair through the splitmix64
+   finaliser, so streams with neighbouring keys - replication i and i+1,
+   or two buffer sizes - start from unrelated points of the generator
+   rather than from states that differ in one bit, and the result does
+   not depend on which thread runs the replication.
+
+   A simulation that needs several streams (run length, interarrival
+   times, packet lengths) uses keys stream*RNG_SUBSTREAMS + k. */
+
+#define RNG_SUBSTREAMS	4
+
+static inline unsigned long long rng_mix(unsigned long long x)
+{
+	x += 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return x ^ (x >> 31);
+}
+
+static inline void rng_seed(unsigned short x[3], unsigned long long seed,
+                            unsigned long long stream)
+{
+	unsigned long long v = rng_mix(seed ^ rng_mix(stream));
+
+	x[0] = (unsigned short) v;
+	x[1] = (unsigned short) (v >> 16);
+	x[2] = (unsigned short) (v >> 32);
+}
+
+#endif /* RNG_H */
@@ -0,0 +1,165 @@
+/* runner.h - work-stealing thread pool for independent replications */
+
+#ifndef RUNNER_H
+#define RUNNER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* runner_run(nthreads, njobs, fn, arg) calls fn(job, worker, arg) once
+   for every job in 0..njobs-1 and returns when all of them are done.
+
+   Each worker starts with an equal contiguous share of the job numbers
+   and takes work from the front of its own share.  A worker that runs
+   dry steals the back half of the largest remaining share, so uneven
+   run lengths (total_events is random) still keep every core busy.
+   'worker' is in 0..nthreads-1 and lets fn reuse per-worker storage
+   such as a SIM.
+
+   Jobs must not depend on which worker runs them or in what order;
+   results are written to a slot indexed by job and reduced afterwards.
+
+   build with -pthread */
+
+typedef void (*RUNNER_JOB)(int job, int worker, void *arg);
+
+typedef struct{
+	pthread_mutex_t lock;
+	int lo, hi;                        /* jobs lo..hi-1 are still to run */
+} RUNNER_SHARE;
+
+typedef struct{
+	RUNNER_SHARE *share;               /* one per worker */
+	int nthreads;
+	RUNNER_JOB fn;
+	void *arg;
+} RUNNER;
+
+typedef struct{
+	RUNNER *r;
+	int worker;
+} RUNNER_ARG;
+
+/**************************************************************************/
+static inline int runner_threads(void)
+/* number of workers to use: $RUNNER_THREADS, else the online cores */
+{
+	const char *s = getenv("RUNNER_THREADS");
+	long n;
+
+	if (s != NULL && atoi(s) > 0)
+		return atoi(s);
+	n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int) n : 1;
+}
+
+/**************************************************************************/
+static inline int runner_steal(RUNNER *r, int self)
+/* moves the back half of the largest other share into worker self's
+   share; returns 0 when there is nothing left anywhere */
+{
+	RUNNER_SHARE *mine = &r->share[self], *v;
+	int i, best, most, lo, hi;
+
+	for (;;) {
+		best = -1;
+		most = 0;
+		for (i = 0; i < r->nthreads; ++i) {
+			if (i == self)
+				continue;
+			v = &r->share[i];
+			pthread_mutex_lock(&v->lock);
+			if (v->hi - v->lo > most) {
+				most = v->hi - v->lo;
+				best = i;
+			}
+			pthread_mutex_unlock(&v->lock);
+		}
+		if (best < 0)
+			return 0;
+		v = &r->share[best];
+		pthread_mutex_lock(&v->lock);
+		lo = v->lo;
+		hi = v->hi;
+		if (hi > lo) {
+			v->hi = lo + (hi - lo) / 2;
+			pthread_mutex_unlock(&v->lock);
+			pthread_mutex_lock(&mine->lock);
+			mine->lo = lo + (hi - lo) / 2;
+			mine->hi = hi;
+			pthread_mutex_unlock(&mine->lock);
+			return 1;
+		}
+		pthread_mutex_unlock(&v->lock);
+	}
+}
+
+static inline void *runner_worker(void *p)
+{
+	RUNNER_ARG *a = (RUNNER_ARG *) p;
+	RUNNER *r = a->r;
+	RUNNER_SHARE *mine = &r->share[a->worker];
+	int job;
+
+	for (;;) {
+		pthread_mutex_lock(&mine->lock);
+		job = mine->lo < mine->hi ? mine->lo++ : -1;
+		pthread_mutex_unlock(&mine->lock);
+		if (job >= 0)
+			r->fn(job, a->worker, r->arg);
+		else if (!runner_steal(r, a->worker))
+			break;
+	}
+	return NULL;
+}
+
+/**************************************************************************/
+static inline void runner_run(int nthreads, int njobs, RUNNER_JOB fn, void *arg)
+{
+	RUNNER r;
+	RUNNER_ARG *a;
+	pthread_t *tid;
+	int i;
+
+	if (nthreads > njobs)
+		nthreads = njobs;
+	if (nthreads <= 1) {
+		for (i = 0; i < njobs; ++i)
+			fn(i, 0, arg);
+		return;
+	}
+	r.nthreads = nthreads;
+	r.fn = fn;
+	r.arg = arg;
+	r.share = (RUNNER_SHARE *) malloc(nthreads * sizeof(RUNNER_SHARE));
+	a = (RUNNER_ARG *) malloc(nthreads * sizeof(RUNNER_ARG));
+	tid = (pthread_t *) malloc(nthreads * sizeof(pthread_t));
+	if (r.share == NULL || a == NULL || tid == NULL) {
+		fprintf(stderr, "runner: out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < nthreads; ++i) {
+		pthread_mutex_init(&r.share[i].lock, NULL);
+		r.share[i].lo = (int) ((long long) njobs * i / nthreads);
+		r.share[i].hi = (int) ((long long) njobs * (i + 1) / nthreads);
+		a[i].r = &r;
+		a[i].worker = i;
+	}
+	for (i = 1; i < nthreads; ++i)
+		if (pthread_create(&tid[i], NULL, runner_worker, &a[i]) != 0) {
+			fprintf(stderr, "runner: cannot create thread\n");
+			exit(1);
+		}
+	runner_worker(&a[0]);
+	for (i = 1; i < nthreads; ++i)
+		pthread_join(tid[i], NULL);
+	for (i = 0; i < nthreads; ++i)
+		pthread_mutex_destroy(&r.share[i].lock);
+	free(r.share);
+	free(a);
+	free(tid);
+}
+
+#endif /* RUNNER_H */
@@ -0,0 +1,138 @@
+/* snap.h - byte buffer for snapshots of simulation state */
+
+#ifndef SNAP_H
+#define SNAP_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/* A growable byte string that the *_save() functions append to and
+   the *_load() functions read back in the same order.  A snapshot is
+   meant for the program that wrote it: values are stored as they are in
+   memory, so it is only read back by the same build on the same kind
+   of machine, and gw_load() checks the build.
+
+   Readers work on a copy of the SNAP with its own position, so any
+   number of threads can load one snapshot at once.
+
+   A zero-initialised SNAP is empty and valid. */
+
+#define SNAP_MAGIC	"GWSNAP01"
+
+typedef struct{
+	char *buf;
+	size_t len;                        /* bytes held */
+	size_t cap;                        /* bytes allocated */
+	size_t pos;                        /* next byte to read */
+	int bad;                           /* a read ran past the end */
+} SNAP;
+
+/**************************************************************************/
+static inline char *snap_room(SNAP *sn, size_t n)
+/* appends n bytes for the caller to fill in, and returns them */
+{
+	char *p;
+
+	if (sn->len + n > sn->cap) {
+		sn->cap = sn->cap ? 2 * sn->cap : 4096;
+		while (sn->cap < sn->len + n)
+			sn->cap *= 2;
+		sn->buf = (char *) realloc(sn->buf, sn->cap);
+		if (sn->buf == NULL) {
+			fprintf(stderr, "snap: out of memory\n");
+			exit(1);
+		}
+	}
+	p = sn->buf + sn->len;
+	sn->len += n;
+	return p;
+}
+
+static inline void snap_put(SNAP *sn, const void *p, size_t n) /* appends n bytes */
+{
+	memcpy(snap_room(sn, n), p, n);
+}
+
+static inline int snap_get(SNAP *sn, void *p, size_t n)
+/* reads the next n bytes into p; returns 0, or -1 (and sets bad) if
+   there are not that many */
+{
+	if (sn->bad || n > sn->len - sn->pos) {
+		sn->bad = 1;
+		memset(p, 0, n);
+		return -1;
+	}
+	memcpy(p, sn->buf + sn->pos, n);
+	sn->pos += n;
+	return 0;
+}
+
+static inline void snap_clear(SNAP *sn) /* empties sn, keeping its storage */
+{
+	sn->len = sn->pos = 0;
+	sn->bad = 0;
+}
+
+static inline void snap_free(SNAP *sn)
+{
+	free(sn->buf);
+	memset(sn, 0, sizeof(SNAP));
+}
+
+/**************************************************************************/
+static inline int snap_write(const SNAP *sn, const char *path)
+/* saves sn to a file; returns 0, or -1 after a message */
+{
+	FILE *f = fopen(path, "wb");
+	uint64_t len = sn->len;
+	int bad;
+
+	if (f == NULL) {
+		fprintf(stderr, "snap: cannot create %s\n", path);
+		return -1;
+	}
+	bad = fwrite(SNAP_MAGIC, 8, 1, f) != 1 || fwrite(&len, sizeof(len), 1, f) != 1 ||
+	      (len > 0 && fwrite(sn->buf, len, 1, f) != 1);
+	if (fclose(f) != 0 || bad) {
+		fprintf(stderr, "snap: cannot write %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static inline int snap_read(SNAP *sn, const char *path)
+/* replaces sn with the snapshot in a file; returns 0, or -1 after a
+   message */
+{
+	FILE *f = fopen(path, "rb");
+	char magic[8];
+	uint64_t len;
+
+	if (f == NULL) {
+		fprintf(stderr, "snap: cannot open %s\n", path);
+		return -1;
+	}
+	snap_clear(sn);
+	if (fread(magic, 8, 1, f) != 1 || memcmp(magic, SNAP_MAGIC, 8) != 0 ||
+	    fread(&len, sizeof(len), 1, f) != 1) {
+		fprintf(stderr, "snap: %s is not a snapshot\n", path);
+		fclose(f);
+		return -1;
+	}
+	sn->len = 0;
+	sn->cap = 0;
+	free(sn->buf);
+	sn->buf = (char *) malloc(len > 0 ? len : 1);
+	if (sn->buf == NULL || (len > 0 && fread(sn->buf, len, 1, f) != 1)) {
+		fprintf(stderr, "snap: %s is cut short\n", path);
+		fclose(f);
+		return -1;
+	}
+	sn->len = sn->cap = len;
+	fclose(f);
+	return 0;
+}
+
+#endif /* SNAP_H */
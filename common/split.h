@@ -0,0 +1,179 @@
+/* split.h - loss probability by fixed-effort splitting on buffer levels */
+
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "rng.h"
+#include "snap.h"
+#include "gateway.h"
+
+/* A loss of 1e-6 needs some 1e8 arrivals of plain simulation to see a
+   hundred drops, nearly all of them spent far below the buffer limit.
+   Splitting spends the effort near the limit instead.
+
+   The steady-state loss is E[drops per busy cycle] / E[arrivals per
+   cycle] (regenerative at the empty system).  Levels 0 < L1 < ... < Lm
+   < buffer_size split a cycle at the first arrival that takes q_len to
+   each level, and the drops of a cycle are those before L1, plus those
+   between L1 and L2, and so on:
+
+     stage 0   effort cycles from empty: the arrivals and the drops
+               before L1, and the state (a snapshot) at each first entry
+               to L1; p1 the fraction of cycles that got there
+     stage k   effort paths, each from one of the level-k entry states
+               in turn on new random streams, until q_len reaches L(k+1)
+               (keeping that state, pk+1 the fraction that got there) or
+               the system empties; the drops on the way.  Paths of the
+               last stage run until the system empties.
+
+   Then E[drops per cycle] = sum over k of p1...pk * (drops in stage k)
+   / effort, an unbiased estimate, and its ratio to the stage 0 mean of
+   arrivals per cycle is the loss.  Every path is a copy of the whole
+   SIM by gw_save()/gw_load(), so any GW_POLICY works, as long as the
+   queue is stable so that cycles end.
+
+   The levels are spread evenly up to buffer_size (or util_octets, if
+   lower), which makes the pk roughly equal when the tail of q_len is
+   near exponential.  Repeating
+   split_run() on independent streams gives the CI.  Trajectory j draws
+   on streams 2j and 2j+1 of the key given to split_run().
+
+   split_init() allocates the entry states; split_free() releases them. */
+
+#define SPLIT_MAX_LEVELS	64
+#define SPLIT_LEVELS		8	/* default number of levels */
+
+typedef struct{
+	int effort;                        /* paths per stage */
+	int levels;                        /* m */
+	SNAP *at, *next;                   /* entry states of this level and the next */
+	int nat, nnext;
+
+	/* results of the last split_run() */
+	double loss;
+	double qlen;                       /* mean number in system seen by arrivals, stage 0 */
+	double p[SPLIT_MAX_LEVELS + 1];    /* p[k]: the fraction that reached level k */
+	long events;                       /* events simulated */
+} SPLIT;
+
+/**************************************************************************/
+static inline void split_init(SPLIT *sp, int effort, int levels)
+{
+	sp->effort = effort > 0 ? effort : 1;
+	sp->levels = levels < 1 ? 1 : levels > SPLIT_MAX_LEVELS ? SPLIT_MAX_LEVELS : levels;
+	sp->at = (SNAP *) calloc(sp->effort, sizeof(SNAP));
+	sp->next = (SNAP *) calloc(sp->effort, sizeof(SNAP));
+	if (sp->at == NULL || sp->next == NULL) {
+		fprintf(stderr, "split: out of memory\n");
+		exit(1);
+	}
+	sp->nat = sp->nnext = 0;
+}
+
+static inline void split_free(SPLIT *sp)
+{
+	int i;
+
+	for (i = 0; i < sp->effort; ++i) {
+		snap_free(&sp->at[i]);
+		snap_free(&sp->next[i]);
+	}
+	free(sp->at);
+	free(sp->next);
+	sp->at = sp->next = NULL;
+}
+
+static inline double split_level(SPLIT *sp, SIM *s, int k)
+/* L_k in octets, below the buffer or the utilisation limit, whichever
+   is lower */
+{
+	double top = s->util_octets < s->buffer_size ? s->util_octets : s->buffer_size;
+
+	return k * top / (sp->levels + 1);
+}
+
+static inline void split_keep(SPLIT *sp, SIM *s) /* an entry to the next level */
+{
+	snap_clear(&sp->next[sp->nnext]);
+	gw_save(s, &sp->next[sp->nnext++]);
+}
+
+/**************************************************************************/
+static inline double split_run(SPLIT *sp, SIM *s, unsigned long long key)
+/* one estimate of the loss of s, which has been started empty
+   (gw_start()) on its stage 0 streams; returns it, and leaves it in
+   sp->loss with the level probabilities in sp->p */
+{
+	SNAP *t;
+	double level = split_level(sp, s, 1), reach, drops;
+	long cycles = 0, arrivals, lost, d = 0, j = 0;
+	int i, k, above = 0, type;
+
+	/* stage 0: plain cycles */
+	sp->nnext = 0;
+	sp->events = 0;
+	while (cycles < sp->effort) {
+		lost = s->nloss + s->batch_nloss;
+		type = gw_step(s);
+		sp->events++;
+		if (!above) {
+			d += s->nloss + s->batch_nloss - lost;
+			if (type == ARRIVAL && s->q_len >= level) {
+				split_keep(sp, s);
+				above = 1;
+			}
+		}
+		if (type == DEPARTURE && s->q == 0) {
+			cycles++;
+			above = 0;
+		}
+	}
+	arrivals = s->narr;
+	sp->qlen = (double) s->q_sum / s->narr;
+	drops = (double) d / sp->effort;
+	reach = sp->p[1] = (double) sp->nnext / sp->effort;
+
+	/* stages 1..m, each from the entries of the last */
+	for (k = 1; k <= sp->levels && sp->nnext > 0; ++k) {
+		t = sp->at;
+		sp->at = sp->next;
+		sp->next = t;
+		sp->nat = sp->nnext;
+		sp->nnext = 0;
+		level = k < sp->levels ? split_level(sp, s, k + 1) : HUGE_VAL;
+		d = 0;
+		for (i = 0; i < sp->effort; ++i, ++j) {
+			if (gw_load(s, &sp->at[i % sp->nat]) < 0)
+				exit(1);
+			rng_seed(s->arr.rng, key, 2 * j);
+			rng_seed(s->len.rng, key, 2 * j + 1);
+			expgen_reset(&s->arr);
+			expgen_reset(&s->len);
+			for (;;) {
+				lost = s->nloss + s->batch_nloss;
+				type = gw_step(s);
+				sp->events++;
+				d += s->nloss + s->batch_nloss - lost;
+				if (type == DEPARTURE && s->q == 0)
+					break;
+				if (type == ARRIVAL && s->q_len >= level) {
+					split_keep(sp, s);
+					break;
+				}
+			}
+		}
+		drops += reach * d / sp->effort;
+		if (k < sp->levels)
+			reach *= sp->p[k + 1] = (double) sp->nnext / sp->effort;
+	}
+	for (++k; k <= sp->levels; ++k)    /* levels never reached */
+		sp->p[k] = 0;
+	sp->loss = drops * sp->effort / arrivals;
+	return sp->loss;
+}
+
+#endif /* SPLIT_H */
@@ -0,0 +1,114 @@
+/* spsc.h - lock-free single-producer single-consumer ring */
+
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+/* A bounded FIFO of fixed-size items between exactly one producer thread
+   and one consumer thread, with no locks: the producer owns 'tail' and
+   the consumer 'head', each publishes its index with a release store and
+   reads the other's with an acquire load.  Both indices run freely and
+   are masked into the ring, whose size is a power of two.
+
+   Each side keeps its last view of the other's index on its own cache
+   line, so while the ring is neither empty nor full the two threads do
+   not touch a shared line.
+
+   spsc_init() must be called before use; spsc_free() releases the ring. */
+
+#define SPSC_LINE	64                 /* bytes per cache line */
+
+typedef struct{
+	_Atomic unsigned head;             /* next item to read: the consumer's */
+	unsigned tail_seen;                /* the consumer's view of tail */
+	char pad0[SPSC_LINE - 2 * sizeof(unsigned)];
+	_Atomic unsigned tail;             /* next item to write: the producer's */
+	unsigned head_seen;                /* the producer's view of head */
+	char pad1[SPSC_LINE - 2 * sizeof(unsigned)];
+	char *item;                        /* cap items of 'size' bytes */
+	size_t size;
+	unsigned cap;                      /* a power of two */
+} SPSC;
+
+/**************************************************************************/
+static inline void spsc_init(SPSC *q, unsigned cap, size_t size)
+/* makes q an empty ring of at least cap items of size bytes */
+{
+	unsigned n = 2;
+
+	while (n < cap)
+		n *= 2;
+	q->item = (char *) malloc((size_t) n * size);
+	if (q->item == NULL) {
+		fprintf(stderr, "spsc: out of memory\n");
+		exit(1);
+	}
+	q->size = size;
+	q->cap = n;
+	atomic_init(&q->head, 0);
+	atomic_init(&q->tail, 0);
+	q->tail_seen = q->head_seen = 0;
+}
+
+static inline void spsc_free(SPSC *q)
+{
+	free(q->item);
+	q->item = NULL;
+	q->cap = 0;
+}
+
+/**************************************************************************/
+/* producer side */
+
+static inline unsigned spsc_room(SPSC *q) /* items that can be pushed now */
+{
+	unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	if (tail - q->head_seen == q->cap)
+		q->head_seen = atomic_load_explicit(&q->head, memory_order_acquire);
+	return q->cap - (tail - q->head_seen);
+}
+
+static inline int spsc_push(SPSC *q, const void *x)
+/* appends a copy of *x; returns 0 if the ring is full */
+{
+	unsigned tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+	if (tail - q->head_seen == q->cap) {
+		q->head_seen = atomic_load_explicit(&q->head, memory_order_acquire);
+		if (tail - q->head_seen == q->cap)
+			return 0;
+	}
+	memcpy(q->item + (size_t) (tail & (q->cap - 1)) * q->size, x, q->size);
+	atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+	return 1;
+}
+
+/**************************************************************************/
+/* consumer side */
+
+static inline void *spsc_peek(SPSC *q)
+/* the oldest item, left in the ring, or NULL if there is none */
+{
+	unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	if (head == q->tail_seen) {
+		q->tail_seen = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if (head == q->tail_seen)
+			return NULL;
+	}
+	return q->item + (size_t) (head & (q->cap - 1)) * q->size;
+}
+
+static inline void spsc_pop(SPSC *q) /* drops the item spsc_peek() returned */
+{
+	unsigned head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	atomic_store_explicit(&q->head, head + 1, memory_order_release);
+}
+
+#endif /* SPSC_H */
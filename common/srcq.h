@@ -0,0 +1,152 @@
+/* srcq.h - next send times of many independent traffic sources */
+
+#ifndef SRCQ_H
+#define SRCQ_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "snap.h"
+
+/* One pending time per source, merged in a winner (tournament) tree so
+   that the earliest source is found in O(1) and a source's new time is
+   put in place with log2(n) comparisons, whatever the number of sources.
+   Only the earliest source needs an entry in the event list, so the
+   list stays as small as with one aggregate source.
+
+   The times are a flat array indexed by source, and each internal node
+   of the tree holds the source that wins its subtree: node 1 is the
+   root, node k has children 2k and 2k+1, and the leaves are nodes
+   m..2m-1 for the m = 2^k >= n slots.  Slots beyond n hold SRCQ_NEVER
+   and never win, and neither does a source given that time (one that
+   never sends).  Times are doubles, with SRCQ_NEVER HUGE_VAL, unless
+   SRCQ_TIME and SRCQ_NEVER are defined before the include (as
+   gateway.h's GW_TICKS does).
+
+   srcq_save() and srcq_load() put the times in a snap.h snapshot and
+   back.
+
+   A zero-initialised SRCQ is valid; srcq_reset() sizes it before use. */
+
+#ifndef SRCQ_TIME
+#define SRCQ_TIME	double
+#define SRCQ_NEVER	HUGE_VAL
+#endif
+
+typedef struct{
+	SRCQ_TIME *time;                   /* next send time of each slot */
+	int *win;                          /* win[k]: slot winning node k */
+	int n;                             /* sources */
+	int m;                             /* slots, a power of two >= n */
+	int cap;                           /* slots allocated */
+} SRCQ;
+
+/**************************************************************************/
+static inline void srcq_play(SRCQ *q, int k) /* replays node k from its children */
+{
+	int a = 2 * k < q->m ? q->win[2 * k] : 2 * k - q->m;
+	int b = 2 * k + 1 < q->m ? q->win[2 * k + 1] : 2 * k + 1 - q->m;
+
+	q->win[k] = q->time[a] <= q->time[b] ? a : b;
+}
+
+static inline void srcq_build(SRCQ *q) /* replays the whole tree, O(n) */
+{
+	int k;
+
+	for (k = q->m - 1; k >= 1; --k)
+		srcq_play(q, k);
+}
+
+static inline void srcq_reset(SRCQ *q, int n)
+/* sizes q for n >= 1 sources, none of which has a time yet; set them
+   all with srcq_fill() and then call srcq_build() */
+{
+	int i, m = 2;
+
+	while (m < n)
+		m *= 2;
+	if (m > q->cap) {
+		free(q->time);
+		free(q->win);
+		q->time = (SRCQ_TIME *) malloc(m * sizeof(SRCQ_TIME));
+		q->win = (int *) malloc(m * sizeof(int));
+		if (q->time == NULL || q->win == NULL) {
+			fprintf(stderr, "srcq: out of memory\n");
+			exit(1);
+		}
+		q->cap = m;
+	}
+	q->n = n;
+	q->m = m;
+	for (i = 0; i < m; ++i)
+		q->time[i] = SRCQ_NEVER;
+}
+
+static inline void srcq_fill(SRCQ *q, int i, SRCQ_TIME time)
+/* sets the time of source i without replaying the tree */
+{
+	q->time[i] = time;
+}
+
+/**************************************************************************/
+static inline int srcq_min(SRCQ *q) /* the source with the earliest time */
+{
+	return q->win[1];
+}
+
+static inline SRCQ_TIME srcq_time(SRCQ *q) /* and that time */
+{
+	return q->time[q->win[1]];
+}
+
+static inline void srcq_set(SRCQ *q, int i, SRCQ_TIME time)
+/* gives source i a new time and replays its path to the root */
+{
+	int k;
+
+	q->time[i] = time;
+	for (k = (q->m + i) / 2; k >= 1; k /= 2)
+		srcq_play(q, k);
+}
+
+static inline void srcq_free(SRCQ *q)
+{
+	free(q->time);
+	free(q->win);
+	q->time = NULL;
+	q->win = NULL;
+	q->n = q->m = q->cap = 0;
+}
+
+static inline void srcq_save(SRCQ *q, SNAP *sn)
+{
+	snap_put(sn, &q->n, sizeof(int));
+	if (q->n > 0)
+		snap_put(sn, q->time, q->n * sizeof(SRCQ_TIME));
+}
+
+static inline int srcq_load(SRCQ *q, SNAP *sn)
+/* returns 0, or -1 if the snapshot ran out */
+{
+	int i, n;
+	SRCQ_TIME t;
+
+	if (snap_get(sn, &n, sizeof(int)) < 0 || n < 0)
+		return -1;
+	if (n == 0) {
+		q->n = 0;
+		return 0;
+	}
+	srcq_reset(q, n);
+	for (i = 0; i < n; ++i) {
+		if (snap_get(sn, &t, sizeof(SRCQ_TIME)) < 0)
+			return -1;
+		srcq_fill(q, i, t);
+	}
+	srcq_build(q);
+	return 0;
+}
+
+#endif /* SRCQ_H */
@@ -0,0 +1,73 @@
+/* stats.h - streaming mean, variance and confidence interval */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <math.h>
+
+/* A STAT summarises a stream of observations in O(1) memory: the count,
+   the running mean and the sum of squared deviations from it, updated
+   by Welford's method in double precision.  Unlike summing x and x*x,
+   this does not lose the variance to cancellation when the spread is
+   small against the mean, as it is for loss probabilities near 0.001.
+
+   Two STATs over disjoint streams combine exactly with stat_merge()
+   (Chan, Golub and LeVeque), so each worker thread can keep its own and
+   the totals are merged after the threads are joined.  The merged
+   result equals the single-stream one up to rounding.
+
+   A zero-initialised STAT is valid and empty. */
+
+#define STAT_Z95	1.96	/* normal quantile for a two-sided 95% CI */
+
+typedef struct{
+	long n;                            /* observations so far */
+	double mean;
+	double m2;                         /* sum of squared deviations from mean */
+} STAT;
+
+/**************************************************************************/
+static inline void stat_add(STAT *s, double x) /* adds one observation */
+{
+	double d = x - s->mean;
+
+	s->n++;
+	s->mean += d / s->n;
+	s->m2 += d * (x - s->mean);
+}
+
+static inline void stat_merge(STAT *a, const STAT *b) /* adds b's observations to a */
+{
+	long n = a->n + b->n;
+	double d = b->mean - a->mean;
+
+	if (b->n == 0)
+		return;
+	if (a->n == 0) {
+		*a = *b;
+		return;
+	}
+	a->mean += d * b->n / n;
+	a->m2 += b->m2 + d * d * ((double) a->n * b->n / n);
+	a->n = n;
+}
+
+static inline void stat_reset(STAT *s)
+{
+	s->n = 0;
+	s->mean = 0;
+	s->m2 = 0;
+}
+
+/**************************************************************************/
+static inline double stat_var(const STAT *s) /* sample variance, n-1 divisor */
+{
+	return s->n > 1 ? s->m2 / (s->n - 1) : 0.0;
+}
+
+static inline double stat_hw(const STAT *s) /* half-width of the 95% CI of the mean */
+{
+	return s->n > 0 ? STAT_Z95 * sqrt(stat_var(s) / s->n) : 0.0;
+}
+
+#endif /* STATS_H */
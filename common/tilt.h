@@ -0,0 +1,145 @@
+/* tilt.h - loss probability by importance sampling with tilted negexps */
+
+#ifndef TILT_H
+#define TILT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "rng.h"
+#include "snap.h"
+#include "gateway.h"
+
+#if !GW_TILT
+#error "tilt.h needs the gateway built with GW_TILT 1"
+#endif
+
+/* Plain simulation rarely sees the buffer fill when the loss is small.
+   Importance sampling draws from distributions under which it fills
+   often, and weighs every outcome by the likelihood ratio of the real
+   distributions to the ones drawn from, which keeps the estimate
+   unbiased.
+
+   The loss is E[drops per cycle] / E[packets per cycle] over the
+   regenerative cycles that begin with an arrival to the empty system.
+   tilt_run() simulates 'cycles' of them plainly, for the packets and the
+   mean queue length.  At the start of each it keeps the state, runs one
+   more cycle from it with the tilt on (gw_draw(), GW_TILT), and goes
+   back to the state to carry on plainly.  The tilted copies thus begin
+   as the plain ones do, including where q3's every-batch_interval-th
+   rule stands.
+
+   The tilt is the classic one for a queue near overflow: arrivals at the
+   service rate and service at the arrival rate, i.e. mean interarrival
+   time times rho and mean packet length over rho, for rho the offered
+   load in packets, so the tilted load is 1/rho.  At the first drop of a
+   tilted cycle the real distributions return, and the drops from then on
+   until the system empties count with the likelihood ratio of the draws
+   made so far.  Tilted cycle j draws on streams 2j and 2j+1 of the key
+   given to tilt_run().
+
+   The queue must be stable (rho < 1); at rho >= 1 there is nothing to
+   gain and the cycles run untilted.  Any admission policy works: drops
+   are counted, not overflows. */
+
+typedef struct{
+	int cycles;                        /* cycles per estimate */
+	SNAP at;                           /* the state at the start of a cycle */
+
+	/* results of the last tilt_run() */
+	double loss[2];                    /* of single [0] and batch [1] packets */
+	double qlen;                       /* mean number in system seen by arrivals */
+	double rho;                        /* offered load the tilt was set from */
+	double hit;                        /* fraction of tilted cycles with a drop */
+	long events;                       /* events simulated, plain and tilted */
+} TILT;
+
+/**************************************************************************/
+static inline void tilt_init(TILT *t, int cycles)
+{
+	memset(t, 0, sizeof(TILT));
+	t->cycles = cycles > 0 ? cycles : 1;
+}
+
+static inline void tilt_free(TILT *t)
+{
+	snap_free(&t->at);
+}
+
+static inline double tilt_rho(SIM *s) /* offered load of s in packets */
+{
+	double per_arrival = GW_HOSTS;
+
+#if GW_BATCH
+	if (s->batch_interval < INT_MAX)
+		per_arrival *= (s->batch_interval - 1.0 + s->batch_size) / s->batch_interval;
+#endif
+	return per_arrival * s->mean_pkt_length * s->byte_time / s->iat;
+}
+
+/**************************************************************************/
+static inline void tilt_cycle(TILT *t, SIM *s, double *drops)
+/* one tilted cycle of s, from the empty system, adding its drops of
+   each class, weighted, to drops[] */
+{
+	long long nloss = s->nloss, batch_nloss = s->batch_nloss;
+	double lr;
+
+	s->tilt[0] = t->rho;
+	s->tilt[1] = 1 / t->rho;
+	s->tilted = t->rho < 1;
+	s->log_lr = 0;
+	do {
+		gw_step(s);
+		t->events++;
+		if (s->tilted && s->nloss + s->batch_nloss > nloss + batch_nloss) {
+			s->tilted = 0;
+			t->hit++;
+		}
+	} while (s->q > 0);
+	lr = exp(s->log_lr);
+	drops[0] += lr * (s->nloss - nloss);
+	drops[1] += lr * (s->batch_nloss - batch_nloss);
+}
+
+static inline double tilt_run(TILT *t, SIM *s, unsigned long long key)
+/* one estimate of the loss of s, which is empty (after gw_start(), or
+   a previous tilt_run()); returns the loss of single packets, and leaves
+   both classes' in t->loss */
+{
+	double drops[2] = {0, 0};
+	int j;
+	long long narr = s->narr, q_sum = s->q_sum;
+	long long single = s->total_packets - s->batch_packets, batch = s->batch_packets;
+
+	t->rho = tilt_rho(s);
+	t->hit = 0;
+	t->events = 0;
+	for (j = 0; j < t->cycles; ++j) {
+		/* s is empty, and its next event is the arrival that begins
+		   cycle j */
+		snap_clear(&t->at);
+		gw_save(s, &t->at);
+		rng_seed(s->arr.rng, key, 2 * j);
+		rng_seed(s->len.rng, key, 2 * j + 1);
+		expgen_reset(&s->arr);
+		expgen_reset(&s->len);
+		tilt_cycle(t, s, drops);
+		if (gw_load(s, &t->at) < 0)
+			exit(1);
+		do {
+			gw_step(s);
+			t->events++;
+		} while (s->q > 0);
+	}
+	t->hit /= t->cycles;
+	t->qlen = (double) (s->q_sum - q_sum) / (s->narr - narr);
+	single = s->total_packets - s->batch_packets - single;
+	batch = s->batch_packets - batch;
+	t->loss[0] = single > 0 ? drops[0] / single : 0;
+	t->loss[1] = batch > 0 ? drops[1] / batch : 0;
+	return t->loss[0];
+}
+
+#endif /* TILT_H */
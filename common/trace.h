@@ -0,0 +1,206 @@
+/* trace.h - memory-mapped binary packet traces */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* A trace is a header and then one fixed-size record per packet, in
+   order of time, in the byte order of the machine that wrote it:
+
+       TRACE_HEAD   magic "GWTRACE1", byte-order mark, record size,
+                    number of records
+       TRACE_REC    time in ns from the start of the capture, length
+                    in octets, sending host and class (1: batch traffic)
+
+   trace_open() maps the whole file read-only and the records are used
+   where they lie, with no parsing or copying per packet, so a trace of
+   any size replays at the speed of the page cache (or the disk).  The
+   records are 16 bytes and aligned, four to a cache line.
+
+   A TRACE_CURSOR walks a run of records, possibly all of them, as one
+   arrival process: times are in seconds from the first record of the
+   run, and the run repeats, shifted by its length plus one mean gap,
+   for as long as it is read. */
+
+#define TRACE_MAGIC	"GWTRACE1"
+#define TRACE_BOM	0x01020304u
+
+typedef struct{
+	char magic[8];                     /* TRACE_MAGIC, no terminator */
+	uint32_t bom;                      /* TRACE_BOM as written */
+	uint32_t rec_size;                 /* sizeof(TRACE_REC) */
+	uint64_t count;                    /* records that follow */
+} TRACE_HEAD;
+
+typedef struct{
+	uint64_t time;                     /* ns from the start of the capture */
+	uint32_t len;                      /* octets */
+	uint16_t host;                     /* sender */
+	uint16_t cls;                      /* 0 single packets, 1 batch traffic */
+} TRACE_REC;
+
+typedef struct{
+	void *map;                         /* the mapped file */
+	size_t size;
+	const TRACE_REC *rec;              /* its records */
+	long count;
+} TRACE;
+
+typedef struct{
+	const TRACE_REC *first, *end;      /* the run */
+	const TRACE_REC *next;             /* the record that arrives next */
+	double base;                       /* seconds added to its time */
+	double span;                       /* seconds from one pass to the next */
+	long passes;                       /* times the run has wrapped around */
+} TRACE_CURSOR;
+
+/**************************************************************************/
+static inline int trace_open(TRACE *t, const char *path)
+/* maps the trace at path; returns 0, or -1 after a message */
+{
+	const TRACE_HEAD *h;
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+
+	memset(t, 0, sizeof(TRACE));
+	if (fd < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "trace: cannot open %s\n", path);
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	if ((size_t) st.st_size < sizeof(TRACE_HEAD)) {
+		fprintf(stderr, "trace: %s is not a trace\n", path);
+		close(fd);
+		return -1;
+	}
+	t->size = st.st_size;
+	t->map = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);                         /* the mapping keeps the file */
+	if (t->map == MAP_FAILED) {
+		fprintf(stderr, "trace: cannot map %s\n", path);
+		t->map = NULL;
+		return -1;
+	}
+	h = (const TRACE_HEAD *) t->map;
+	if (memcmp(h->magic, TRACE_MAGIC, 8) != 0 || h->bom != TRACE_BOM ||
+	    h->rec_size != sizeof(TRACE_REC) ||
+	    h->count > (t->size - sizeof(TRACE_HEAD)) / sizeof(TRACE_REC)) {
+		fprintf(stderr, "trace: %s is not a trace of this machine, or is cut short\n", path);
+		munmap(t->map, t->size);
+		t->map = NULL;
+		return -1;
+	}
+	t->rec = (const TRACE_REC *) (h + 1);
+	t->count = h->count;
+	/* read ahead aggressively and drop pages behind */
+	madvise(t->map, t->size, MADV_SEQUENTIAL);
+	return 0;
+}
+
+static inline void trace_close(TRACE *t)
+{
+	if (t->map != NULL)
+		munmap(t->map, t->size);
+	memset(t, 0, sizeof(TRACE));
+}
+
+static inline double trace_rate(const TRACE *t) /* mean packets a second */
+{
+	double d;
+
+	if (t->count < 2)
+		return 0;
+	d = (t->rec[t->count - 1].time - t->rec[0].time) * 1e-9;
+	return d > 0 ? (t->count - 1) / d : 0;
+}
+
+/**************************************************************************/
+static inline void trace_cursor(TRACE_CURSOR *c, const TRACE *t, long from, long n)
+/* c walks the n >= 1 records from 'from' on */
+{
+	double d;
+
+	c->first = c->next = t->rec + from;
+	c->end = c->first + n;
+	d = (c->end[-1].time - c->first->time) * 1e-9;
+	c->span = n > 1 ? d * n / (n - 1) : 1.0;
+	if (c->span <= 0)                  /* all at one instant */
+		c->span = 1e-9;
+	c->base = -(c->first->time * 1e-9);
+	c->passes = 0;
+}
+
+static inline double trace_time(const TRACE_CURSOR *c) /* arrival time of c->next */
+{
+	return c->next->time * 1e-9 + c->base;
+}
+
+static inline const TRACE_REC *trace_step(TRACE_CURSOR *c)
+/* the next record, moving c past it */
+{
+	const TRACE_REC *r = c->next;
+
+	if (++c->next == c->end) {
+		c->next = c->first;
+		c->base += c->span;
+		c->passes += 1;
+	}
+	return r;
+}
+
+/**************************************************************************/
+/* writing */
+
+static inline FILE *trace_create(const char *path)
+/* opens a new trace for trace_put(); trace_finish() writes its count */
+{
+	TRACE_HEAD h;
+	FILE *f = fopen(path, "wb");
+
+	if (f == NULL) {
+		fprintf(stderr, "trace: cannot create %s\n", path);
+		return NULL;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TRACE_MAGIC, 8);
+	h.bom = TRACE_BOM;
+	h.rec_size = sizeof(TRACE_REC);
+	fwrite(&h, sizeof(h), 1, f);
+	return f;
+}
+
+static inline void trace_put(FILE *f, uint64_t time, uint32_t len, int host, int cls)
+{
+	TRACE_REC r;
+
+	r.time = time;
+	r.len = len;
+	r.host = (uint16_t) host;
+	r.cls = (uint16_t) cls;
+	fwrite(&r, sizeof(r), 1, f);
+}
+
+static inline int trace_finish(FILE *f, uint64_t count)
+/* closes f; returns 0, or -1 after a message */
+{
+	int bad = fseek(f, offsetof(TRACE_HEAD, count), SEEK_SET) != 0 ||
+	          fwrite(&count, sizeof(count), 1, f) != 1;
+
+	if (fclose(f) != 0 || bad) {
+		fprintf(stderr, "trace: cannot write the trace\n");
+		return -1;
+	}
+	return 0;
+}
+
+#endif /* TRACE_H */
@@ -0,0 +1,208 @@
+/* program net.c */
+
+/* Networks of gateways: each node is the drop-tail gateway of the other
+   programs, and packets leaving a node travel on to the next one over a
+   link with a fixed delay, or leave the network.  The nodes run in
+   parallel as the logical processes of common/net.h.
+
+   usage:  net [-g chain:N | -g ring:N | -g grid:WxH | -f file]
+               [-r iar] [-b buffer] [-p forward] [-d delay]
+               [-e seconds] [-t threads] [-s seed]
+
+   chain:N   node 0 receives iar packets/s, node i sends to node i+1
+   ring:N    every node receives iar, sends a share 'forward' to the next
+   grid:WxH  every node receives iar, sends forward/2 right and down;
+             the share of a missing neighbour leaves the network
+
+   A file lists the topology one item per line ('#' starts a comment):
+
+       node <iar> [buffer]                 numbered from 0 in order
+       link <from> <to> <share> <delay>
+
+   One row per node gives its external and forwarded arrivals, its loss,
+   the mean time in the network of its departing packets and of those
+   leaving the network there, and the number of them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/runner.h"
+#include "../common/net.h"
+
+#define R_CAPACITY 10        /* gateway processing capacity */
+#define MEAN_PKT_LENGTH 1000 /* mean packet length */
+#define BUFFER_SIZE 41984    /* max buffer size to hold packets */
+#define IAR 1000             /* external packets/s per receiving node */
+#define FORWARD 0.8          /* share of departures sent on (ring, grid) */
+#define DELAY 0.001          /* link delay in seconds */
+#define SECONDS 100          /* simulated time */
+
+int topology(NET *, const char *, int, int, double, double);
+int topology_file(NET *, const char *, int, int, double);
+double now(void);
+
+/**************************************************************************/
+int main(int argc, char *argv[]){
+	NET net = {0};
+	NET_NODE *v;
+	STAT exit_delay = {0};
+	const char *gen = "chain:100", *file = NULL;
+	int c, i, nthreads = runner_threads();
+	int iar = IAR, buffer = BUFFER_SIZE;
+	double forward = FORWARD, delay = DELAY, wall;
+	long events = 0, nulls = 0;
+
+	net.end = SECONDS;
+	net.seed = time(NULL);
+	while ((c = getopt(argc, argv, "g:f:r:b:p:d:e:t:s:")) != -1) {
+		switch (c) {
+			case 'g':
+				gen = optarg;
+				break;
+			case 'f':
+				file = optarg;
+				break;
+			case 'r':
+				iar = atoi(optarg);
+				break;
+			case 'b':
+				buffer = atoi(optarg);
+				break;
+			case 'p':
+				forward = atof(optarg);
+				break;
+			case 'd':
+				delay = atof(optarg);
+				break;
+			case 'e':
+				net.end = atof(optarg);
+				break;
+			case 't':
+				nthreads = atoi(optarg);
+				break;
+			case 's':
+				net.seed = atol(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-g chain:N|ring:N|grid:WxH | -f file] [-r iar] [-b buffer]\n"
+						"\t[-p forward] [-d delay] [-e seconds] [-t threads] [-s seed]\n", argv[0]);
+				exit(1);
+		}
+	}
+	if ((file != NULL ? topology_file(&net, file, iar, buffer, delay)
+	                  : topology(&net, gen, iar, buffer, forward, delay)) < 0)
+		exit(1);
+
+	wall = now();
+	net_run(&net, nthreads);
+	wall = now() - wall;
+
+	printf("# node ext received loss delay exit_delay exits\n");
+	for (i = 0; i < net.nnodes; ++i) {
+		v = &net.node[i];
+		printf("%d %lld %ld %.6f %.6f %.6f %ld\n", i, v->s.narr, v->received,
+		       v->s.narr + v->received > 0 ?
+		       (double) v->s.nloss / (v->s.narr + v->received) : 0.0,
+		       v->s.packet_delay.mean, v->exit_delay.mean, v->exits);
+		stat_merge(&exit_delay, &v->exit_delay);
+		events += v->events;
+	}
+	for (i = 0; i < net.nlinks; ++i)
+		nulls += net.link[i].nulls;
+	printf("# %d nodes, %d links, %g s: network delay %.6f (hw %.6f) over %ld packets\n",
+	       net.nnodes, net.nlinks, net.end, exit_delay.mean, stat_hw(&exit_delay),
+	       exit_delay.n);
+	printf("# %ld events and %ld null messages in %.3f s on %d threads (%.0f events/s)\n",
+	       events, nulls, wall, nthreads < net.nnodes ? nthreads : net.nnodes,
+	       events / wall);
+	net_free(&net);
+	return(0);
+}
+
+/**************************************************************************/
+int topology(NET *n, const char *gen, int iar, int buffer, double forward, double delay)
+/* builds a chain, ring or grid; returns 0, or -1 after a message */
+{
+	int i, j, w, h, k;
+
+	if (sscanf(gen, "chain:%d", &k) == 1 && k > 0) {
+		for (i = 0; i < k; ++i)
+			net_add_node(n, i == 0 ? iar : 0, buffer, R_CAPACITY, MEAN_PKT_LENGTH);
+		for (i = 0; i + 1 < k; ++i)
+			net_add_link(n, i, i + 1, 1.0, delay);
+	}
+	else if (sscanf(gen, "ring:%d", &k) == 1 && k > 0) {
+		for (i = 0; i < k; ++i)
+			net_add_node(n, iar, buffer, R_CAPACITY, MEAN_PKT_LENGTH);
+		for (i = 0; k > 1 && i < k; ++i)
+			net_add_link(n, i, (i + 1) % k, forward, delay);
+	}
+	else if (sscanf(gen, "grid:%dx%d", &w, &h) == 2 && w > 0 && h > 0) {
+		for (i = 0; i < w * h; ++i)
+			net_add_node(n, iar, buffer, R_CAPACITY, MEAN_PKT_LENGTH);
+		for (j = 0; j < h; ++j)
+			for (i = 0; i < w; ++i) {
+				if (i + 1 < w)
+					net_add_link(n, j * w + i, j * w + i + 1, forward / 2, delay);
+				if (j + 1 < h)
+					net_add_link(n, j * w + i, (j + 1) * w + i, forward / 2, delay);
+			}
+	}
+	else {
+		fprintf(stderr, "net: unknown topology '%s'\n", gen);
+		return -1;
+	}
+	return 0;
+}
+
+int topology_file(NET *n, const char *path, int iar, int buffer, double delay)
+/* reads nodes and links from a file; iar, buffer and delay are the
+   defaults for what a line leaves out */
+{
+	FILE *f = fopen(path, "r");
+	char line[1024], word[16], *s;
+	int a, b;
+	double x, y;
+
+	if (f == NULL) {
+		fprintf(stderr, "net: cannot open %s\n", path);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f) != NULL) {
+		if ((s = strchr(line, '#')) != NULL)
+			*s = '\0';
+		if (sscanf(line, " %15s", word) != 1)
+			continue;
+		a = iar;
+		b = buffer;
+		y = delay;
+		if (strcmp(word, "node") == 0) {
+			sscanf(line, " node %d %d", &a, &b);
+			net_add_node(n, a, b, R_CAPACITY, MEAN_PKT_LENGTH);
+		}
+		else if (strcmp(word, "link") != 0 ||
+		         sscanf(line, " link %d %d %lf %lf", &a, &b, &x, &y) < 3 ||
+		         net_add_link(n, a, b, x, y) < 0) {
+			fprintf(stderr, "net: cannot read '%s' in %s\n", word, path);
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	if (n->nnodes == 0) {
+		fprintf(stderr, "net: no nodes in %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+double now(void) /* monotonic wall clock in seconds */
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
@@ -2,274 +2,789 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <limits.h>
+#include <unistd.h>
+
+#include "../common/rng.h"
+#include "../common/runner.h"
+#include "../common/stats.h"
+#include "../common/mm1k.h"
+
+/* drop-tail, and no admission while utilisation is above 0.9 */
+#define GW_POLICY	gw_admit_util
+#include "../common/gateway.h"
+#include "../common/split.h"
+#include "../common/lanes.h"
 
-#define NEW(type) (type *) malloc(sizeof(type))
-#define ARRIVAL 	1
-#define DEPARTURE	2
 #define NUM_HOSTS	10
 #define TOTAL_SIZE	100
+#define LOSS_TARGET	0.001	/* default loss probability the buffer must achieve */
+#define CONFIDENCE	0.95	/* required confidence that it is achieved */
+#define MAX_KB		(1 << 20)	/* give up the search beyond this */
+#define SEQ_FIRST	10	/* first batch under sequential stopping */
+#define SEQ_MAX		100000	/* default cap on replications per point */
+#define LR_CHUNKS	1000	/* long-run mode: stretches recorded per run */
+#define LR_BATCHES	20	/* and batch means formed after the warm-up */
+#define LANES_CHUNK	(4 * LANES)	/* observations per job under -V */
+
+/* variance reduction modes, may be combined */
+#define VR_CRN		1	/* common random numbers across buffer sizes */
+#define VR_ANTITHETIC	2	/* replications in antithetic pairs */
 
 /* Event by event simulation of a router queue with finite waiting
    room */
 
-
-double 
-  gmt,    /* absolute time */
-  iat;    /* mean interarrival time */
-
-int
-  q,       /* number of packets in the system */
-  narr,    /* number of arrivals */
-  nloss,   /* number of lost packets */
-  q_sum,   /* sum of queue lengths at arrival instants */ 
-  q_len,   /* queue length n octets */ 
-  r_capacity,        /* router processing capacity */
-  buffer_size,       /* max buffer size to hold packets */		
-  mean_pkt_length,   /* mean packet length */
-  total_events;      /* number of events to be simulated */
-
-long
-  seed;   /* seed for the random number generator */
-
-typedef struct schedule_info{
-  double time;                       /* Time that event occurs */
-  int event_type;                    /* Type of event */
-  struct schedule_info *next;        /* Pointer to next item in linked list */
-  } EVENTLIST;
-
-typedef struct packet_info{
-  int pkt_len;                       /* Length of packet */ 			
-  struct packet_info *next;          /* Pointer to next packet in linked list */
-  } PACKET_Q;
-
-struct schedule_info
-  *head,
-  *tail;
-
-struct packet_info
-  *headPkt,
-  *tailPkt;
-
-int  act(void);
-double  negexp(double);
-double  srv_time(int);
-void arrival(void);
-void departure(void);
-void schedule(double, int);
-void sim_init(void);
-float run();
-float sdv(float *num, float mean, int size);
+void sim_init(SIM *, long, long, int, int);
+void sim_seed(SIM *, long, long, int);
+double run(SIM *);
+void replicate(int, int, void *);
+void replicate_lanes(int, int, void *);
+void longrun(int, int, void *);
+void warmup(int, int, void *);
+int mser(double *, int);
+
+/* Running totals for one buffer size */
+typedef struct{
+  STAT loss;        /* independent observations of the loss: replications,
+                       or antithetic pair averages */
+  STAT raw;         /* the loss of every replication on its own */
+  STAT qlen;        /* mean queue length seen by arrivals, per observation */
+  long over;        /* replications with loss above the target */
+  long warm;        /* long-run mode: arrivals discarded as warm-up */
+  } TALLY;
+
+/* The result of one observation of a sweep round */
+typedef struct{
+  double raw[2];    /* the loss of each of its replications */
+  int nraw;         /* 1, or 2 for an antithetic pair */
+  double loss;      /* their average */
+  double qlen;      /* and that of their mean queue lengths */
+  } OBS;
+
+/* One round of the buffer sweep: observations first_obs..first_obs+obs-1
+   of each of npoints consecutive buffer sizes, shared out between the
+   workers */
+typedef struct{
+  long seed;        /* seed of the whole sweep */
+  int first_kb;     /* buffer size of the first point, in KB */
+  int npoints;      /* buffer sizes in this round */
+  int obs;          /* observations per point in this round */
+  int first_obs;    /* number of the first of them */
+  SIM *sim;         /* one per worker */
+  int nthreads;
+  OBS *res;         /* res[point*obs + observation]: this round's results,
+                       added up in that order whatever worker ran them */
+  int nres;         /* room in res */
+  TALLY *part;      /* long-run mode: part[run], each run's totals */
+  int vr;           /* VR_CRN | VR_ANTITHETIC */
+  double abs_hw;    /* sequential stopping: target CI half-width, */
+  double rel_hw;    /* or target half-width relative to the mean */
+  int max_reps;     /* and the most replications to spend on a point */
+  long run_len;     /* long-run mode: arrivals per run; 0 for replications */
+  long warm;        /* fork mode: arrivals of the warm-up; 0 starts empty */
+  SNAP *snap;       /* fork mode: snap[point], the warmed-up state, */
+  int *snap_kb;     /* of the buffer size snap_kb[point] */
+  SPLIT *split;     /* splitting mode: one per worker; NULL otherwise */
+  LANESIM *lanes;   /* lockstep lanes (-V): one per worker; NULL otherwise */
+  double target;    /* loss probability the buffer must achieve */
+  } SWEEP;
+
+#define SEQUENTIAL(w)	((w)->abs_hw > 0 || (w)->rel_hw > 0)
+#define PER_OBS(w)	((w)->vr & VR_ANTITHETIC ? 2 : 1)	/* replications per observation */
+/* buffer size, loss and its CI half-width; rare targets need exponents */
+#define LOSS_FMT(w)	((w)->target < 1e-4 ? "%d %.4e %.2e" : "%d %.6f %0.6f")
+
+void sweep_round(SWEEP *, int, int, int, int);
+void sim_job(SIM *, SWEEP *, int, int);
+void gather(SWEEP *, int, TALLY *);
+int estimate(SWEEP *, int, TALLY *);
+double evaluate(SWEEP *, int);
+int bisect(SWEEP *, int);
+int analytic(SWEEP *, int);
 
 /**************************************************************************/
-int main(){
-	seed = time(NULL);
-	float prob[TOTAL_SIZE];
-	int iter;
-	float avg = 1;
-	float current;
-	int counter;
+int main(int argc, char *argv[]){
+	SWEEP w;
+	TALLY t;
+	STAT d;
+	int iter, p, c;
 	int if_continue = 1;
-	buffer_size = 30;
+	int buffer_size = 30;     /* buffer size in KB */
+	int nthreads = runner_threads();
+	int npoints;
+	int search = 0, exact = 0;
+	double *prev = NULL;
+	OBS *x;
+	double var, pvar = 0;
+	int n, have_prev = 0;
+	int effort = 0, levels = SPLIT_LEVELS, vector = 0;
 	
-	while(if_continue){
-		avg = 0;
-		for(iter=0; iter<TOTAL_SIZE; ++iter){
-			sim_init();
-			current = run();
-			avg += current;
-			if(current>0.001)
-				counter++;
-			buffer_size /= 1024;
-			prob[iter] = current;
+	w.seed = time(NULL);      /* seed for the random number generator */
+	w.vr = 0;
+	w.abs_hw = w.rel_hw = 0;
+	w.max_reps = SEQ_MAX;
+	w.run_len = 0;
+	w.warm = 0;
+	w.target = LOSS_TARGET;
+	while ((c = getopt(argc, argv, "AabcF:L:l:m:r:T:t:s:Vw:x:")) != -1) {
+		switch (c) {
+			case 'A':
+				exact = 1;
+				break;
+			case 'a':
+				w.vr |= VR_ANTITHETIC;
+				break;
+			case 'b':
+				search = 1;
+				break;
+			case 'c':
+				w.vr |= VR_CRN;
+				break;
+			case 'F':
+				w.warm = atol(optarg);
+				break;
+			case 'L':
+				levels = atoi(optarg);
+				break;
+			case 'l':
+				w.run_len = atol(optarg);
+				break;
+			case 'm':
+				w.max_reps = atoi(optarg);
+				break;
+			case 'r':
+				w.rel_hw = atof(optarg);
+				break;
+			case 'T':
+				w.target = atof(optarg);
+				break;
+			case 'V':
+				vector = 1;
+				break;
+			case 'w':
+				w.abs_hw = atof(optarg);
+				break;
+			case 't':
+				nthreads = atoi(optarg);
+				break;
+			case 's':
+				w.seed = atol(optarg);
+				break;
+			case 'x':
+				effort = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-A] [-a] [-b] [-c] [-w half-width] [-r relative half-width]\n"
+						"\t[-m max replications] [-l arrivals per long run] [-F warm-up arrivals]\n"
+						"\t[-x splitting effort [-L levels] | -V] [-T loss target] [-t threads] [-s seed]\n",
+						argv[0]);
+				exit(1);
 		}
-		printf("%d %.6f %0.6f\n", buffer_size, avg/100, 
-				1.96*sdv(prob, avg/100, TOTAL_SIZE)/sqrt(TOTAL_SIZE));
-		if(counter<=5){
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	if (w.target <= 0 || w.target >= 1)
+		w.target = LOSS_TARGET;
+	if (effort > 0) {
+		/* every observation is one splitting estimate of the steady-state
+		   loss, from empty */
+		w.vr &= ~VR_ANTITHETIC;
+		w.run_len = 0;
+		w.warm = 0;
+	}
+	w.max_reps += w.max_reps & 1;    /* whole antithetic pairs */
+	if (w.max_reps < SEQ_FIRST)
+		w.max_reps = SEQ_FIRST;
+	if (w.run_len < 0)
+		w.run_len = 0;
+	if (w.run_len > 0 && w.run_len < LR_CHUNKS)
+		w.run_len = LR_CHUNKS;
+	if (w.run_len > 0)
+		w.vr &= ~VR_ANTITHETIC;
+	if (w.warm < 0 || w.run_len > 0)   /* a long run warms itself up */
+		w.warm = 0;
+	/* run enough buffer sizes at once to give every worker a few
+	   replications; points past the answer are thrown away */
+	npoints = (4 * nthreads + TOTAL_SIZE - 1) / TOTAL_SIZE;
+	w.nthreads = nthreads;
+	w.sim = (SIM *) calloc(nthreads, sizeof(SIM));
+	w.res = NULL;
+	w.nres = 0;
+	w.part = (TALLY *) malloc(nthreads * sizeof(TALLY));
+	w.snap = (SNAP *) calloc(npoints, sizeof(SNAP));
+	w.snap_kb = (int *) calloc(npoints, sizeof(int));
+	w.split = NULL;
+	if (effort > 0) {
+		w.split = (SPLIT *) malloc(nthreads * sizeof(SPLIT));
+		for(iter=0; iter<nthreads; ++iter)
+			split_init(&w.split[iter], effort, levels);
+	}
+	/* lockstep lanes run replications from empty only */
+	w.lanes = vector && effort <= 0 && w.run_len == 0 && w.warm == 0 ?
+	          lanes_alloc(nthreads) : NULL;
+	if (w.vr & VR_CRN)
+		prev = (double *) malloc(TOTAL_SIZE * sizeof(double));
+	if (exact) {
+		analytic(&w, 1);
+		if_continue = 0;
+	}
+	else if (search) {
+		/* start from the analytic answer, less the 10-20% by which it
+		   errs on the large side (mm1k.h) */
+		if ((n = analytic(&w, 0)) > 0)
+			buffer_size = n - n / 7 > 0 ? n - n / 7 : 1;
+		bisect(&w, buffer_size);
+		if_continue = 0;
+	}
+	
+	while(if_continue && (SEQUENTIAL(&w) || w.run_len > 0)){
+		/* one buffer size at a time, each with as many replications as
+		   its CI needs (or one long run per worker); stop once no more
+		   than 5% of the replications or batches miss the target, as the
+		   fixed sweep does with 5 out of 100 */
+		n = estimate(&w, buffer_size, &t);
+		printf(LOSS_FMT(&w), buffer_size, t.loss.mean, stat_hw(&t.loss));
+		if (w.run_len > 0)
+			printf(" %d warm %ld q %.4f %.4f\n", n, t.warm / nthreads, t.qlen.mean, stat_hw(&t.qlen));
+		else
+			printf(" %d q %.4f %.4f\n", n, t.qlen.mean, stat_hw(&t.qlen));
+		if(t.over*20<=n){
 			if_continue = 0;
-		}	
+		}
 		buffer_size++;
-		counter = 0;
-		avg = 0;
 		fprintf (stderr, "******************   %d  *********************", buffer_size-1);		
 	}
+	
+	while(if_continue){
+		sweep_round(&w, buffer_size, npoints, 0, TOTAL_SIZE / PER_OBS(&w));
+		for(p=0; p<npoints && if_continue; ++p){
+			memset(&t, 0, sizeof(TALLY));
+			gather(&w, p, &t);
+			printf(LOSS_FMT(&w), buffer_size, t.loss.mean, stat_hw(&t.loss));
+			if (w.vr != 0) {
+				/* the CI comes from the independent observations (pair
+				   averages under antithetic sampling); the reduction is
+				   the variance of the mean that independent replications
+				   would have had, over the achieved one */
+				var = stat_var(&t.loss);
+				printf(" vr %.2f", var > 0 ? (stat_var(&t.raw)/t.raw.n)/(var/t.loss.n) : 0.0);
+				if (w.vr & VR_CRN) {
+					x = &w.res[p * w.obs];
+					if (have_prev) {
+						/* paired difference from the previous buffer size,
+						   against the variance if the two were independent */
+						stat_reset(&d);
+						for(iter=0; iter<w.obs; ++iter)
+							stat_add(&d, x[iter].loss - prev[iter]);
+						printf(" diff %.6f %0.6f vr %.2f", d.mean, stat_hw(&d),
+								stat_var(&d) > 0 ? (var + pvar)/stat_var(&d) : 0.0);
+					}
+					for(iter=0; iter<w.obs; ++iter)
+						prev[iter] = x[iter].loss;
+					pvar = var;
+					have_prev = 1;
+				}
+			}
+			printf(" q %.4f %.4f\n", t.qlen.mean, stat_hw(&t.qlen));
+			if(t.over<=5){
+				if_continue = 0;
+			}	
+			buffer_size++;
+			fprintf (stderr, "******************   %d  *********************", buffer_size-1);		
+		}
+	}
 
+	for(iter=0; iter<nthreads; ++iter)
+		gw_free(&w.sim[iter]);
+	free(w.sim);
+	free(w.part);
+	free(w.res);
+	free(prev);
+	for(iter=0; iter<npoints; ++iter)
+		snap_free(&w.snap[iter]);
+	free(w.snap);
+	free(w.snap_kb);
+	for(iter=0; effort > 0 && iter<nthreads; ++iter)
+		split_free(&w.split[iter]);
+	free(w.split);
+	if (w.lanes != NULL)
+		lanes_free(w.lanes, nthreads);
 	return 0;	
 }
 
-float sdv(float *num, float mean, int size){
-	int i = 0;
-	float dv;
-	for(; i<size; ++i){
-		dv += (num[i]-mean)*(num[i]-mean);
+/**************************************************************************/
+void sweep_round(SWEEP *w, int kb, int npoints, int first_obs, int obs)
+/* runs observations first_obs..first_obs+obs-1 of the npoints buffer
+   sizes from kb KB up, leaving their results in w->res */
+{
+	w->first_kb = kb;
+	w->npoints = npoints;
+	w->first_obs = first_obs;
+	w->obs = obs;
+	if (npoints * obs > w->nres) {
+		free(w->res);
+		w->nres = npoints * obs;
+		w->res = (OBS *) malloc(w->nres * sizeof(OBS));
+		if (w->res == NULL) {
+			fprintf(stderr, "r_ssq_n: out of memory\n");
+			exit(1);
+		}
 	}
-	dv /= size;
-	return sqrt(dv);
+	if (w->warm > 0)
+		runner_run(w->nthreads, npoints, warmup, w);
+	if (w->lanes != NULL)
+		runner_run(w->nthreads, (npoints * obs + LANES_CHUNK - 1) / LANES_CHUNK, replicate_lanes, w);
+	else
+		runner_run(w->nthreads, npoints * obs, replicate, w);
 }
 
-float run(){
-int i;
-  while (narr < total_events){
-    switch (act()){
-      case ARRIVAL:
-        arrival();
-      
-        break;
-      case DEPARTURE:
-        departure();
-        break;
-      default:
-        printf("error in act procedure\n");
-        exit(1);
-        break;
-      } /* end switch */
-  }      /* end while */
-/*  printf("The mean queue length seen by arriving customers is: %8.4f\n",
-         ((float) q_sum) / narr);
-  printf("Probablity a packet is blocked is: %8.4f\n",
-         ((float) nloss) / narr);
- */ 
-  fprintf (stderr, "%.6f\n", ((float) nloss) / narr);
-  return ((float) nloss) / narr;
-
-} /* end main */
 /**************************************************************************/
-double negexp(double mean) /* returns a negexp rv with mean `mean' */
-
+void gather(SWEEP *w, int p, TALLY *t)
+/* adds the observations of point p of the last round to t, in order,
+   so the totals do not depend on which worker ran which */
 {
-  return (- log(drand48()) * mean);
+	OBS *r;
+	int i, k;
+
+	for (i = 0; i < w->obs; ++i) {
+		r = &w->res[p * w->obs + i];
+		for (k = 0; k < r->nraw; ++k) {
+			stat_add(&t->raw, r->raw[k]);
+			if (r->raw[k] > w->target)
+				t->over++;
+		}
+		stat_add(&t->loss, r->loss);
+		stat_add(&t->qlen, r->qlen);
+	}
 }
 
 /**************************************************************************/
-double srv_time(int pkt_length) /* returns the service time for given length */
-
+int estimate(SWEEP *w, int kb, TALLY *t)
+/* runs replications with a kb KB buffer and leaves their totals in t.
+   Without sequential stopping that is TOTAL_SIZE replications; with it,
+   batches are launched until the half-width of the 95% CI of the loss
+   reaches the absolute or relative target or max_reps have run, each
+   batch sized from the current variance to hit the target (but at most
+   doubling the count).  Returns the number of replications.
+
+   In long-run mode each worker makes one long run instead and the
+   totals are over its batch means; returns the number of batches. */
 {
-  double service_time = (pkt_length*8.0)/(r_capacity*pow(10.0,6.0));
-  return (service_time);
+	int per = PER_OBS(w);
+	long n, batch;
+	double hw, target, need;
+
+	memset(t, 0, sizeof(TALLY));
+	if (w->run_len > 0) {
+		w->first_kb = kb;
+		memset(w->part, 0, w->nthreads * sizeof(TALLY));
+		runner_run(w->nthreads, w->nthreads, longrun, w);
+		for (n = 0; n < w->nthreads; ++n) {
+			stat_merge(&t->loss, &w->part[n].loss);
+			stat_merge(&t->raw, &w->part[n].raw);
+			stat_merge(&t->qlen, &w->part[n].qlen);
+			t->over += w->part[n].over;
+			t->warm += w->part[n].warm;
+		}
+		return t->raw.n;
+	}
+	for (;;) {
+		n = t->loss.n;
+		if (!SEQUENTIAL(w))
+			batch = TOTAL_SIZE / per;
+		else if (n == 0)
+			batch = SEQ_FIRST / per;
+		else {
+			hw = stat_hw(&t->loss);
+			target = w->abs_hw > w->rel_hw * t->loss.mean ? w->abs_hw : w->rel_hw * t->loss.mean;
+			if (hw <= target || n >= w->max_reps / per)
+				break;
+			need = target > 0 ? n * (hw / target) * (hw / target) : 2.0 * n;
+			batch = need - n < n ? (long) (need - n) + 1 : n;
+			if (batch < w->nthreads)
+				batch = w->nthreads;
+			if (batch > w->max_reps / per - n)
+				batch = w->max_reps / per - n;
+		}
+		sweep_round(w, kb, 1, n, batch);
+		gather(w, 0, t);
+		if (!SEQUENTIAL(w))
+			break;
+	}
+	return t->raw.n;
 }
 
 /**************************************************************************/
-void arrival() /* a customer arrives */
+double evaluate(SWEEP *w, int kb)
+/* runs the replications for a kb KB buffer, prints the mean loss, its
+   95% CI and the confidence that the mean loss is within the target
+   (one-sided normal test), and returns that confidence */
+{
+	TALLY t;
+	double avg, se, conf;
+	int n;
+
+	n = estimate(w, kb, &t);
+	avg = t.loss.mean;
+	se = stat_hw(&t.loss) / STAT_Z95;
+	if (se > 0)
+		conf = 0.5 * erfc((avg - w->target) / (se * sqrt(2.0)));
+	else
+		conf = avg <= w->target ? 1.0 : 0.0;
+	printf(LOSS_FMT(w), kb, avg, se * STAT_Z95);
+	if (SEQUENTIAL(w) || w->run_len > 0)
+		printf(" %.4f %d", conf, n);
+	else
+		printf(" %.4f", conf);
+	printf(" q %.4f %.4f\n", t.qlen.mean, stat_hw(&t.qlen));
+	return conf;
+}
 
+/**************************************************************************/
+int bisect(SWEEP *w, int kb)
+/* finds the smallest buffer (in KB) whose mean loss is within the target
+   with at least CONFIDENCE, starting from a guess of kb.  Loss falls as
+   the buffer grows, so the answer is bracketed by stepping away from the
+   guess in steps that double, from kb/16, and then bisected: a few
+   evaluations from a close guess, and O(log kb) from any. */
 {
-  struct packet_info *t, *x;
-  narr += 1;                /* keep tally of number of arrivals */
-  q_sum += q;
-  schedule(negexp(iat), ARRIVAL); /* schedule the next arrival */
-
-  int new_pkt_len = (int)(-log(drand48()) * mean_pkt_length); 
-  double utilisation =  (q_len * 8 * iat)/(pow(10.0, 6.0));
-  if(utilisation>0.9){
-  		nloss += 1;
-  	}
-  else if ((new_pkt_len+q_len) <= buffer_size) {
-  /* still space in buffer */
-    q += 1;
-    q_len += new_pkt_len;
-    t = NEW(PACKET_Q);
-    for(x=headPkt ; x->next!=tailPkt ; x=x->next);
-    t->pkt_len = new_pkt_len;
-    t->next = x->next;
-    x->next = t;
-    if (q == 1)
-      schedule(srv_time(headPkt->next->pkt_len), DEPARTURE);
-  }
-  else {
-  /* buffer is full; packet is dropped */
-    nloss += 1;
-  }
+	int lo = 0;        /* largest size known to miss the target */
+	int hi;            /* smallest size known to meet it */
+	int n = 1;
+	int step = kb / 16 > 0 ? kb / 16 : 1;
+	double conf, hi_conf;
+
+	if ((conf = evaluate(w, kb)) >= CONFIDENCE) {
+		hi = kb;
+		hi_conf = conf;
+		while ((kb = hi - step) > 0) {
+			n++;
+			if ((conf = evaluate(w, kb)) < CONFIDENCE) {
+				lo = kb;
+				break;
+			}
+			hi = kb;
+			hi_conf = conf;
+			step *= 2;
+		}
+	}
+	else {
+		lo = kb;
+		for (;;) {
+			kb = lo + step;
+			step *= 2;
+			if (kb > MAX_KB) {
+				printf("loss target %g not met with buffers up to %d KB\n",
+				       w->target, lo);
+				return -1;
+			}
+			n++;
+			if ((conf = evaluate(w, kb)) >= CONFIDENCE) {
+				hi = kb;
+				hi_conf = conf;
+				break;
+			}
+			lo = kb;
+		}
+	}
+	while (hi - lo > 1) {
+		kb = lo + (hi - lo) / 2;
+		n++;
+		if ((conf = evaluate(w, kb)) >= CONFIDENCE) {
+			hi = kb;
+			hi_conf = conf;
+		}
+		else
+			lo = kb;
+	}
+	printf("minimum buffer %d KB: loss <= %g with confidence %.4f (%d evaluations)\n",
+	       hi, w->target, hi_conf, n);
+	return hi;
 }
 
 /**************************************************************************/
-void departure()  /* a customer departs */
+int analytic(SWEEP *w, int print)
+/* the smallest buffer (in KB) whose steady-state loss meets the target
+   by mm1k.h, or -1 if none up to MAX_KB does.  With print, the loss and
+   mean queue length of every size up to it, as the sweep prints them. */
+{
+	SIM *s = &w->sim[0];
+	MM1K r;
+	int kb, best;
+
+	sim_init(s, w->seed, 0, 1, 0);         /* for the rates and limits */
+	best = (int) mm1k_buffer(1.0 / s->iat, s->mean_pkt_length, s->byte_time,
+	                         s->util_octets, w->target, 1024, MAX_KB);
+	if (best > MAX_KB) {
+		printf("loss target %g not met with buffers up to %d KB\n", w->target, MAX_KB);
+		return -1;
+	}
+	for (kb = 1; print && kb <= best; ++kb) {
+		mm1k_octets(&r, 1.0 / s->iat, s->mean_pkt_length, s->byte_time,
+		            kb * 1024.0, s->util_octets);
+		printf(w->target < 1e-4 ? "%d %.4e" : "%d %.6f", kb, r.loss);
+		printf(" analytic q %.4f delay %.6f\n", r.qlen, r.delay);
+	}
+	if (print)
+		printf("minimum buffer %d KB: steady-state loss <= %g (analytic)\n", best, w->target);
+	return best;
+}
 
+/**************************************************************************/
+void replicate(int job, int worker, void *arg) /* runs one observation of a sweep round */
 {
-  struct packet_info *x;
-
-  q -= 1;
-  x = headPkt->next;                 /* Delete event from linked list */
-  q_len -= x->pkt_len;
-  headPkt->next = headPkt->next->next;
-  free(x);
-  if (q > 0)
-    schedule(srv_time(headPkt->next->pkt_len), DEPARTURE);
+	SWEEP *w = (SWEEP *) arg;
+	int p = job / w->obs;
+	int kb = w->first_kb + p;
+	long stream = w->first_obs + job % w->obs;
+	OBS *r = &w->res[job];
+	SIM *s = &w->sim[worker];
+	int k, per = PER_OBS(w);
+	double l, loss = 0, qlen = 0;
+
+	/* the stream depends only on the buffer size and observation number,
+	   not on the worker, so results do not change with the thread count.
+	   Under VR_CRN every buffer size sees the same arrivals and packet
+	   lengths; under VR_ANTITHETIC an observation is a pair of
+	   replications on one stream, the second mirroring each uniform u to
+	   1-u. */
+	if (!(w->vr & VR_CRN))
+		stream += (long) kb << 32;
+	if (w->split != NULL) {
+		/* splitting mode: one estimate from empty, its trajectories on
+		   the spare substream of this observation */
+		sim_init(s, w->seed, stream, kb, 0);
+		l = split_run(&w->split[worker], s,
+		              rng_mix(w->seed ^ rng_mix(stream * RNG_SUBSTREAMS + 3)));
+		fprintf(stderr, "%.6g\n", l);
+		r->raw[0] = r->loss = l;
+		r->nraw = 1;
+		r->qlen = w->split[worker].qlen;
+		return;
+	}
+	for (k = 0; k < per; ++k) {
+		if (w->warm > 0) {
+			/* fork mode: from the warmed-up state, on this observation's
+			   streams, counting afresh */
+			if (gw_load(s, &w->snap[p]) < 0)
+				exit(1);
+			sim_seed(s, w->seed, stream, per == 2 ? 1 + k : 0);
+			gw_clear(s);
+		}
+		else
+			sim_init(s, w->seed, stream, kb, per == 2 ? 1 + k : 0);
+		l = run(s);
+		r->raw[k] = l;
+		loss += l;
+		qlen += (double) s->q_sum / s->narr;
+	}
+	r->nraw = per;
+	r->loss = loss / per;
+	r->qlen = qlen / per;
 }
 
 /**************************************************************************/
+void sim_job(SIM *s, SWEEP *w, int job, int k)
+/* starts replication k of observation job from empty, as replicate()
+   does */
+{
+	int kb = w->first_kb + job / w->obs;
+	long stream = w->first_obs + job % w->obs;
+
+	if (!(w->vr & VR_CRN))
+		stream += (long) kb << 32;
+	sim_init(s, w->seed, stream, kb, PER_OBS(w) == 2 ? 1 + k : 0);
+}
 
+void replicate_lanes(int job, int worker, void *arg)
+/* runs observations job*LANES_CHUNK.. of a sweep round, their
+   replications LANES at a time: a lane takes the next one as soon as it
+   is done with its last.  The results are kept by observation, as
+   replicate() keeps them. */
+{
+	SWEEP *w = (SWEEP *) arg;
+	SIM *s = &w->sim[worker];
+	LANESIM *l = &w->lanes[worker];
+	OBS *r;
+	int first = job * LANES_CHUNK, per = PER_OBS(w);
+	int nobs = w->npoints * w->obs - first < LANES_CHUNK ? w->npoints * w->obs - first : LANES_CHUNK;
+	int n = nobs * per;               /* replications */
+	int rep[LANES], next, i, j, k;
+	double loss[2 * LANES_CHUNK], qlen[2 * LANES_CHUNK], sum, qsum;
+
+	for (next = 0; next < n && next < LANES; ++next) {
+		sim_job(s, w, first + next / per, next % per);
+		lanes_load(l, next, s);
+		rep[next] = next;
+	}
+	while ((j = lanes_run(l)) >= 0) {
+		loss[rep[j]] = (double) l->nloss[j] / l->narr[j];
+		qlen[rep[j]] = (double) l->q_sum[j] / l->narr[j];
+		if (next < n) {
+			sim_job(s, w, first + next / per, next % per);
+			lanes_load(l, j, s);
+			rep[j] = next++;
+		}
+		else
+			lanes_stop(l, j);
+	}
+	for (i = 0; i < nobs; ++i) {
+		r = &w->res[first + i];
+		sum = qsum = 0;
+		for (k = i * per; k < (i + 1) * per; ++k) {
+			fprintf(stderr, "%.6f\n", loss[k]);
+			r->raw[k - i * per] = loss[k];
+			sum += loss[k];
+			qsum += qlen[k];
+		}
+		r->nraw = per;
+		r->loss = sum / per;
+		r->qlen = qsum / per;
+	}
+}
 
 /**************************************************************************/
-void schedule(double time_interval, int event)  /* Schedules an event of type */
-                                             /* 'event' at time 'time_interval' 
-                                                 in the future */
+void warmup(int job, int worker, void *arg)
+/* fork mode: runs the warm-up of one point of a sweep round from empty
+   and keeps its final state, unless the point already has it */
+{
+	SWEEP *w = (SWEEP *) arg;
+	SIM *s = &w->sim[worker];
+	int kb = w->first_kb + job;
+	long stream = -1;                 /* apart from every observation's */
+
+	if (w->snap_kb[job] == kb)
+		return;
+	if (!(w->vr & VR_CRN))
+		stream -= (long) kb << 32;
+	sim_init(s, w->seed, stream, kb, 0);
+	gw_simulate(s, w->warm);
+	snap_clear(&w->snap[job]);
+	gw_save(s, &w->snap[job]);
+	w->snap_kb[job] = kb;
+}
 
+/**************************************************************************/
+void longrun(int job, int worker, void *arg) /* runs one long run of a sweep point */
 {
-double 
-  event_time;
-
-struct schedule_info
-  *x,
-  *t;
-
-event_time = gmt + time_interval;
-t = NEW(EVENTLIST);
-for(x=head ; x->next->time<event_time && x->next!=tail ; x=x->next);
-t->time = event_time;
-t->event_type = event;
-t->next = x->next;
-x->next = t;
+	SWEEP *w = (SWEEP *) arg;
+	TALLY *t = &w->part[job];
+	SIM *s = &w->sim[worker];
+	int kb = w->first_kb;
+	long stream = job;
+	long chunk = w->run_len / LR_CHUNKS;
+	double loss[LR_CHUNKS], qlen[LR_CHUNKS], bl, bq;
+	int i, j, d, size;
+	long long nloss, q_sum;
+
+	/* LR_CHUNKS stretches of chunk arrivals each, recording the loss and
+	   mean queue length of every stretch */
+	if (!(w->vr & VR_CRN))
+		stream += (long) kb << 32;
+	sim_init(s, w->seed, stream, kb, 0);
+	for (i = 0; i < LR_CHUNKS; ++i) {
+		nloss = s->nloss;
+		q_sum = s->q_sum;
+		gw_simulate(s, (i + 1) * chunk);
+		loss[i] = (double) (s->nloss - nloss) / chunk;
+		qlen[i] = (double) (s->q_sum - q_sum) / chunk;
+	}
+	gw_prof_dump(s, stderr);
+
+	/* the run starts empty; drop the warm-up MSER finds in either series,
+	   then average what is left in LR_BATCHES non-overlapping batches
+	   (any remainder goes with the warm-up) */
+	d = mser(qlen, LR_CHUNKS);
+	if ((i = mser(loss, LR_CHUNKS)) > d)
+		d = i;
+	size = (LR_CHUNKS - d) / LR_BATCHES;
+	d = LR_CHUNKS - size * LR_BATCHES;
+	t->warm += (long) d * chunk;
+	for (i = d; i < LR_CHUNKS; i += size) {
+		bl = bq = 0;
+		for (j = i; j < i + size; ++j) {
+			bl += loss[j];
+			bq += qlen[j];
+		}
+		stat_add(&t->loss, bl / size);
+		stat_add(&t->raw, bl / size);
+		stat_add(&t->qlen, bq / size);
+		if (bl / size > w->target)
+			t->over++;
+	}
 }
+
 /**************************************************************************/
-int act()    /* find the next event  and go to it */
+int mser(double *y, int n)
+/* MSER warm-up rule: the truncation point d in 0..n/2 minimising the
+   variance of the mean of y[d..n-1], estimated as m2/(n-d)^2 */
 {
-int 
-  type;
-struct schedule_info 
-  *x;
-
-gmt = head->next->time; /* step time forward to the next event */
-type = head->next->event_type; /*  Record type of this next event */
-x = head->next;                 /* Delete event from linked list */
-head->next = head->next->next;
-free(x);
-return type; /* return value is type of the next event */
+	STAT tail = {0};
+	double v, best = HUGE_VAL;
+	int d, at = 0;
+
+	for (d = n - 1; d >= 0; --d) {
+		stat_add(&tail, y[d]);
+		if (d > n / 2)
+			continue;
+		v = tail.m2 / ((double) (n - d) * (n - d));
+		if (v <= best) {
+			best = v;
+			at = d;
+		}
+	}
+	return at;
 }
-/*************************************************************************/
+
 /**************************************************************************/
-void sim_init()
-/* initialise the simulation */
+double run(SIM *s){
+  gw_simulate(s, s->total_events);
+  gw_prof_dump(s, stderr);
+/*  printf("The mean queue length seen by arriving customers is: %8.4f\n",
+         ((float) s->q_sum) / s->narr);
+  printf("Probablity a packet is blocked is: %8.4f\n",
+         ((float) s->nloss) / s->narr);
+ */ 
+  fprintf (stderr, "%.6f\n", ((double) s->nloss) / s->narr);
+  return ((double) s->nloss) / s->narr;
+
+} /* end main */
+/**************************************************************************/
+void sim_init(SIM *s, long seed, long stream, int buffer_kb, int pair)
+/* initialise the simulation; gw_start() empties the event list and
+   packet buffer of a previous run of s and reuses their storage.  pair is 0
+   for an ordinary replication, 1 or 2 for the first or mirrored half of
+   an antithetic pair. */
 
 { 
   int iar;
   
-  /* providing automated seed from system time */
-  seed++;
-  srand48(seed);
-	srand(seed);
-  head = NEW(EVENTLIST);
-  tail = NEW(EVENTLIST);
-  head->next = tail;
-  tail->next = tail;
-
-  headPkt = NEW(PACKET_Q);
-  tailPkt = NEW(PACKET_Q);
-  headPkt->next = tailPkt;
-  tailPkt->next = tailPkt;
-  
-  total_events = rand()%99000 + 1000;
-  mean_pkt_length = 1000;
-  r_capacity = 10;
+  sim_seed(s, seed, stream, pair);
+  s->mean_pkt_length = 1000;
+  s->r_capacity = 10;
+  s->util_max = 0.9;
   iar = 1125;
-  gmt = 0.0;
-  q = 0;
-  narr = 0;
-  nloss = 0;
-  q_sum = 0;
-  q_len = 0;
-  buffer_size *= 1024;     /* converts size from MB to B (i.e. octets) */
-  iat = 1.0 / iar;
-  schedule(negexp(iat), ARRIVAL); /* schedule the first arrival */
+  s->buffer_size = buffer_kb * 1024;     /* converts size from KB to B (i.e. octets) */
+  gw_start(s, iar);
+}
+
+void sim_seed(SIM *s, long seed, long stream, int pair)
+/* puts s on random streams number 'stream' of this seed, dropping any
+   buffered variates, and draws its run length from them */
+{
+  /* independent random streams number 'stream' of this seed */
+  rng_seed(s->rng, seed, stream * RNG_SUBSTREAMS);
+  rng_seed(s->arr.rng, seed, stream * RNG_SUBSTREAMS + 1);
+  rng_seed(s->len.rng, seed, stream * RNG_SUBSTREAMS + 2);
+  expgen_reset(&s->arr);
+  expgen_reset(&s->len);
+  /* antithetic pairs need variates monotone in their uniforms */
+  s->arr.kernel = s->len.kernel = pair ? EXPGEN_INVERSION : EXPGEN_ZIGGURAT;
+  s->arr.antithetic = s->len.antithetic = (pair == 2);
+  
+  s->total_events = nrand48(s->rng)%99000 + 1000;
 }
 /**************************************************************************/
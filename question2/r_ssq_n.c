@@ -2,266 +2,302 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <time.h>
 #include <limits.h>
+#include <unistd.h>
+
+#include "../common/rng.h"
+#include "../common/runner.h"
+#include "../common/stats.h"
+#include "../common/mm1k.h"
+
+/* drop-tail, and no admission while utilisation is above 0.9; draws
+   that can be tilted for importance sampling (-I) */
+#define GW_POLICY	gw_admit_util
+#define GW_TILT		1
+#include "../common/gateway.h"
+#include "../common/tilt.h"
+#include "../common/lanes.h"
 
-#define NEW(type) (type *) malloc(sizeof(type))
-#define ARRIVAL 	1
-#define DEPARTURE	2
 #define NUM_HOSTS	10
 #define TOTAL_SIZE	100
+#define SEQ_FIRST	10	/* first batch under sequential stopping */
+#define SEQ_MAX		100000	/* default cap on replications */
+#define LANES_CHUNK	(4 * LANES)	/* replications per job under -V */
 
 /* Event by event simulation of a router queue with finite waiting
    room */
 
-
-double 
-  gmt,    /* absolute time */
-  iat;    /* mean interarrival time */
-
-int
-  q,       /* number of packets in the system */
-  narr,    /* number of arrivals */
-  nloss,   /* number of lost packets */
-  q_sum,   /* sum of queue lengths at arrival instants */ 
-  q_len,   /* queue length n octets */ 
-  r_capacity,        /* router processing capacity */
-  buffer_size,       /* max buffer size to hold packets */		
-  mean_pkt_length,   /* mean packet length */
-  total_events;      /* number of events to be simulated */
-
-long
-  seed;   /* seed for the random number generator */
-
-typedef struct schedule_info{
-  double time;                       /* Time that event occurs */
-  int event_type;                    /* Type of event */
-  struct schedule_info *next;        /* Pointer to next item in linked list */
-  } EVENTLIST;
-
-typedef struct packet_info{
-  int pkt_len;                       /* Length of packet */ 			
-  struct packet_info *next;          /* Pointer to next packet in linked list */
-  } PACKET_Q;
-
-struct schedule_info
-  *head,
-  *tail;
-
-struct packet_info
-  *headPkt,
-  *tailPkt;
-
-int  act(void);
-double  negexp(double);
-double  srv_time(int);
-void arrival(void);
-void departure(void);
-void schedule(double, int);
-void sim_init(void);
-float run();
-float sdv(float *num, float mean, int size);
+void sim_init(SIM *, long, long, int);
+double run(SIM *);
+void replicate(int, int, void *);
+void replicate_lanes(int, int, void *);
+
+/* Running totals of the replications of one buffer size */
+typedef struct{
+  STAT loss;        /* loss probability */
+  STAT qlen;        /* mean queue length seen by arrivals */
+  } TALLY;
+
+/* Replications first_rep..first_rep+reps-1 of one buffer size, shared
+   out between the workers */
+typedef struct{
+  long seed;        /* seed of the whole sweep */
+  int first_kb;     /* buffer size in KB */
+  int reps;         /* replications in this batch */
+  int first_rep;    /* number of the first of them */
+  SIM *sim;         /* one per worker */
+  double *loss;     /* loss[rep - first_rep]: this batch's results, */
+  double *qlen;     /* added up in that order whatever worker ran them */
+  int room;         /* replications loss and qlen have room for */
+  TILT *tilt;       /* importance sampling: one per worker; NULL otherwise */
+  LANESIM *lanes;   /* lockstep lanes (-V): one per worker; NULL otherwise */
+  } SWEEP;
 
 /**************************************************************************/
-int main(){
-	seed = time(NULL);
-	float prob[TOTAL_SIZE];
-	int iter;
-	float avg = 1;
-	float current;
-	int counter;
-	int if_continue = 1;
-	buffer_size = 41;
+int main(int argc, char *argv[]){
+	SWEEP w;
+	TALLY t;
+	int iter, c, i;
+	int buffer_size = 41;     /* buffer size in KB */
+	int nthreads = runner_threads();
+	long n, batch;
+	double abs_hw = 0, rel_hw = 0, target, need, hw;
+	int max_reps = SEQ_MAX;
+	int exact = 0, cycles = 0, vector = 0;
+	MM1K a;
 	
-	avg = 0;
-	for(iter=0; iter<TOTAL_SIZE; ++iter){
-		sim_init();
-		current = run();
-		avg += current;
-		
-		buffer_size /= 1024;
-		prob[iter] = current;
+	w.seed = time(NULL);      /* seed for the random number generator */
+	while ((c = getopt(argc, argv, "AB:I:m:r:t:s:Vw:")) != -1) {
+		switch (c) {
+			case 'A':
+				exact = 1;
+				break;
+			case 'B':
+				buffer_size = atoi(optarg);
+				break;
+			case 'I':
+				cycles = atoi(optarg);
+				break;
+			case 'V':
+				vector = 1;
+				break;
+			case 'm':
+				max_reps = atoi(optarg);
+				break;
+			case 'r':
+				rel_hw = atof(optarg);
+				break;
+			case 'w':
+				abs_hw = atof(optarg);
+				break;
+			case 't':
+				nthreads = atoi(optarg);
+				break;
+			case 's':
+				w.seed = atol(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-A] [-B buffer KB] [-I cycles | -V] [-w half-width]\n"
+						"\t[-r relative half-width] [-m max replications] [-t threads] [-s seed]\n",
+						argv[0]);
+				exit(1);
+		}
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	if (max_reps < SEQ_FIRST)
+		max_reps = SEQ_FIRST;
+	if (buffer_size < 1)
+		buffer_size = 1;
+	w.sim = (SIM *) calloc(nthreads, sizeof(SIM));
+	w.loss = w.qlen = NULL;
+	w.room = 0;
+	w.tilt = NULL;
+	if (cycles > 0) {
+		w.tilt = (TILT *) malloc(nthreads * sizeof(TILT));
+		for(iter=0; iter<nthreads; ++iter)
+			tilt_init(&w.tilt[iter], cycles);
+	}
+	w.lanes = vector && cycles <= 0 ? lanes_alloc(nthreads) : NULL;
+	w.first_kb = buffer_size;
+	if (exact) {
+		/* steady state by mm1k.h, for the rates and limits of sim_init() */
+		sim_init(&w.sim[0], w.seed, 0, buffer_size);
+		mm1k_octets(&a, 1.0 / w.sim[0].iat, w.sim[0].mean_pkt_length, w.sim[0].byte_time,
+		            w.sim[0].buffer_size, w.sim[0].util_octets);
+		printf(a.loss < 1e-4 ? "%d %.4e" : "%d %.6f", buffer_size, a.loss);
+		printf(" analytic q %.4f delay %.6f\n", a.qlen, a.delay);
+		gw_free(&w.sim[0]);
+		free(w.sim);
+		free(w.tilt);
+		if (w.lanes != NULL)
+			lanes_free(w.lanes, nthreads);
+		return 0;
 	}
-	printf("%d %.6f %0.6f\n", buffer_size, avg/100, 
-			1.96*sdv(prob, avg/100, TOTAL_SIZE)/sqrt(TOTAL_SIZE));
+	memset(&t, 0, sizeof(TALLY));
 	
+	/* without a target, TOTAL_SIZE replications.  With one (sequential
+	   stopping), launch batches of replications, each sized from the
+	   current variance to reach the target half-width (but at most
+	   doubling the count), until the absolute or relative target is met
+	   or max_reps have run */
+	for (;;) {
+		n = t.loss.n;
+		if (abs_hw <= 0 && rel_hw <= 0)
+			batch = TOTAL_SIZE;
+		else if (n == 0)
+			batch = SEQ_FIRST;
+		else {
+			hw = stat_hw(&t.loss);
+			target = abs_hw > rel_hw * t.loss.mean ? abs_hw : rel_hw * t.loss.mean;
+			if (hw <= target || n >= max_reps)
+				break;
+			need = target > 0 ? n * (hw / target) * (hw / target) : 2.0 * n;
+			batch = need - n < n ? (long) (need - n) + 1 : n;
+			if (batch < nthreads)
+				batch = nthreads;
+			if (batch > max_reps - n)
+				batch = max_reps - n;
+		}
+		w.first_rep = n;
+		w.reps = batch;
+		if (batch > w.room) {
+			free(w.loss);
+			free(w.qlen);
+			w.room = batch;
+			w.loss = (double *) malloc(batch * sizeof(double));
+			w.qlen = (double *) malloc(batch * sizeof(double));
+			if (w.loss == NULL || w.qlen == NULL) {
+				fprintf(stderr, "r_ssq_n: out of memory\n");
+				exit(1);
+			}
+		}
+		if (w.lanes != NULL)
+			runner_run(nthreads, (batch + LANES_CHUNK - 1) / LANES_CHUNK, replicate_lanes, &w);
+		else
+			runner_run(nthreads, batch, replicate, &w);
+		for(i=0; i<batch; ++i){
+			stat_add(&t.loss, w.loss[i]);
+			stat_add(&t.qlen, w.qlen[i]);
+		}
+		if (abs_hw <= 0 && rel_hw <= 0)
+			break;
+	}
+	/* small losses need exponents */
+	printf(t.loss.mean < 1e-4 && t.loss.mean > 0 ? "%d %.4e %.2e" : "%d %.6f %0.6f",
+	       buffer_size, t.loss.mean, stat_hw(&t.loss));
+	if (abs_hw > 0 || rel_hw > 0)
+		printf(" %ld", t.loss.n);
+	printf(" q %.4f %.4f\n", t.qlen.mean, stat_hw(&t.qlen));
 	
-
+	for(iter=0; iter<nthreads; ++iter)
+		gw_free(&w.sim[iter]);
+	for(iter=0; cycles > 0 && iter<nthreads; ++iter)
+		tilt_free(&w.tilt[iter]);
+	free(w.sim);
+	free(w.loss);
+	free(w.qlen);
+	free(w.tilt);
+	if (w.lanes != NULL)
+		lanes_free(w.lanes, nthreads);
 	return 0;	
 }
 
-float sdv(float *num, float mean, int size){
-	int i = 0;
-	float dv;
-	for(; i<size; ++i){
-		dv += (num[i]-mean)*(num[i]-mean);
-	}
-	dv /= size;
-	return sqrt(dv);
-}
-
-float run(){
-int i;
-  while (narr < total_events){
-    switch (act()){
-      case ARRIVAL:
-        arrival();
-      
-        break;
-      case DEPARTURE:
-        departure();
-        break;
-      default:
-        printf("error in act procedure\n");
-        exit(1);
-        break;
-      } /* end switch */
-  }      /* end while */
-/*  printf("The mean queue length seen by arriving customers is: %8.4f\n",
-         ((float) q_sum) / narr);
-  printf("Probablity a packet is blocked is: %8.4f\n",
-         ((float) nloss) / narr);
- */ 
-  fprintf (stderr, "%.6f\n", ((float) nloss) / narr);
-  return ((float) nloss) / narr;
-
-} /* end main */
 /**************************************************************************/
-double negexp(double mean) /* returns a negexp rv with mean `mean' */
-
+void replicate(int job, int worker, void *arg) /* runs one replication */
 {
-  return (- log(drand48()) * mean);
-}
-
-/**************************************************************************/
-double srv_time(int pkt_length) /* returns the service time for given length */
-
-{
-  double service_time = (pkt_length*8.0)/(r_capacity*pow(10.0,6.0));
-  return (service_time);
-}
-
-/**************************************************************************/
-void arrival() /* a customer arrives */
-
-{
-  struct packet_info *t, *x;
-  narr += 1;                /* keep tally of number of arrivals */
-  q_sum += q;
-  schedule(negexp(iat), ARRIVAL); /* schedule the next arrival */
-
-  int new_pkt_len = (int)(-log(drand48()) * mean_pkt_length); 
-  double utilisation =  (q_len * 8 * iat)/(pow(10.0, 6.0));
-  if(utilisation>0.9){
-  		nloss += 1;
-  	}
-  else if ((new_pkt_len+q_len) <= buffer_size) {
-  /* still space in buffer */
-    q += 1;
-    q_len += new_pkt_len;
-    t = NEW(PACKET_Q);
-    for(x=headPkt ; x->next!=tailPkt ; x=x->next);
-    t->pkt_len = new_pkt_len;
-    t->next = x->next;
-    x->next = t;
-    if (q == 1)
-      schedule(srv_time(headPkt->next->pkt_len), DEPARTURE);
-  }
-  else {
-  /* buffer is full; packet is dropped */
-    nloss += 1;
-  }
+	SWEEP *w = (SWEEP *) arg;
+	SIM *s = &w->sim[worker];
+	int kb = w->first_kb;
+	int iter = w->first_rep + job;
+	long stream = ((long) kb << 32) + iter;
+	TILT *t;
+
+	/* the stream depends only on the buffer size and replication number,
+	   not on the worker, so results do not change with the thread count */
+	sim_init(s, w->seed, stream, kb);
+	if (w->tilt != NULL) {
+		/* importance sampling: one estimate over regenerative cycles,
+		   tilted on the spare substream of this replication */
+		t = &w->tilt[worker];
+		tilt_run(t, s, rng_mix(w->seed ^ rng_mix(stream * RNG_SUBSTREAMS + 3)));
+		fprintf(stderr, "%.6g\n", t->loss[0]);
+		w->loss[job] = t->loss[0];
+		w->qlen[job] = t->qlen;
+		return;
+	}
+	w->loss[job] = run(s);
+	w->qlen[job] = (double) s->q_sum / s->narr;
 }
 
-/**************************************************************************/
-void departure()  /* a customer departs */
-
+void replicate_lanes(int job, int worker, void *arg)
+/* runs the job-th LANES_CHUNK of the replications, LANES at a time: a
+   lane takes the next one as soon as it is done with its last.  The
+   results are kept by replication, as replicate() keeps them. */
 {
-  struct packet_info *x;
-
-  q -= 1;
-  x = headPkt->next;                 /* Delete event from linked list */
-  q_len -= x->pkt_len;
-  headPkt->next = headPkt->next->next;
-  free(x);
-  if (q > 0)
-    schedule(srv_time(headPkt->next->pkt_len), DEPARTURE);
+	SWEEP *w = (SWEEP *) arg;
+	SIM *s = &w->sim[worker];
+	LANESIM *l = &w->lanes[worker];
+	int kb = w->first_kb;
+	int first = w->first_rep + job * LANES_CHUNK;
+	int n = w->first_rep + w->reps - first < LANES_CHUNK ? w->first_rep + w->reps - first : LANES_CHUNK;
+	int rep[LANES], next, i, j;
+	double *loss = &w->loss[job * LANES_CHUNK], *qlen = &w->qlen[job * LANES_CHUNK];
+
+	for (next = 0; next < n && next < LANES; ++next) {
+		sim_init(s, w->seed, ((long) kb << 32) + first + next, kb);
+		lanes_load(l, next, s);
+		rep[next] = next;
+	}
+	while ((j = lanes_run(l)) >= 0) {
+		loss[rep[j]] = (double) l->nloss[j] / l->narr[j];
+		qlen[rep[j]] = (double) l->q_sum[j] / l->narr[j];
+		if (next < n) {
+			sim_init(s, w->seed, ((long) kb << 32) + first + next, kb);
+			lanes_load(l, j, s);
+			rep[j] = next++;
+		}
+		else
+			lanes_stop(l, j);
+	}
+	for (i = 0; i < n; ++i)
+		fprintf(stderr, "%.6f\n", loss[i]);
 }
 
-/**************************************************************************/
-
-
-/**************************************************************************/
-void schedule(double time_interval, int event)  /* Schedules an event of type */
-                                             /* 'event' at time 'time_interval' 
-                                                 in the future */
-
-{
-double 
-  event_time;
-
-struct schedule_info
-  *x,
-  *t;
-
-event_time = gmt + time_interval;
-t = NEW(EVENTLIST);
-for(x=head ; x->next->time<event_time && x->next!=tail ; x=x->next);
-t->time = event_time;
-t->event_type = event;
-t->next = x->next;
-x->next = t;
-}
-/**************************************************************************/
-int act()    /* find the next event  and go to it */
-{
-int 
-  type;
-struct schedule_info 
-  *x;
+double run(SIM *s){
+  gw_simulate(s, s->total_events);
+  gw_prof_dump(s, stderr);
+/*  printf("The mean queue length seen by arriving customers is: %8.4f\n",
+         ((float) s->q_sum) / s->narr);
+  printf("Probablity a packet is blocked is: %8.4f\n",
+         ((float) s->nloss) / s->narr);
+ */ 
+  fprintf (stderr, "%.6f\n", ((double) s->nloss) / s->narr);
+  return ((double) s->nloss) / s->narr;
 
-gmt = head->next->time; /* step time forward to the next event */
-type = head->next->event_type; /*  Record type of this next event */
-x = head->next;                 /* Delete event from linked list */
-head->next = head->next->next;
-free(x);
-return type; /* return value is type of the next event */
-}
-/*************************************************************************/
+} /* end main */
 /**************************************************************************/
-void sim_init()
-/* initialise the simulation */
+void sim_init(SIM *s, long seed, long stream, int buffer_kb)
+/* initialise the simulation; gw_start() empties the event list and
+   packet buffer of a previous run of s and reuses their storage */
 
 { 
   int iar;
   
-  /* providing automated seed from system time */
-  seed++;
-  srand48(seed);
-	srand(seed);
-  head = NEW(EVENTLIST);
-  tail = NEW(EVENTLIST);
-  head->next = tail;
-  tail->next = tail;
-
-  headPkt = NEW(PACKET_Q);
-  tailPkt = NEW(PACKET_Q);
-  headPkt->next = tailPkt;
-  tailPkt->next = tailPkt;
+  /* independent random streams number 'stream' of this seed */
+  rng_seed(s->rng, seed, stream * RNG_SUBSTREAMS);
+  rng_seed(s->arr.rng, seed, stream * RNG_SUBSTREAMS + 1);
+  rng_seed(s->len.rng, seed, stream * RNG_SUBSTREAMS + 2);
   
-  total_events = rand()%99000 + 1000;
-  mean_pkt_length = 1000;
-  r_capacity = 10;
+  s->total_events = nrand48(s->rng)%99000 + 1000;
+  s->mean_pkt_length = 1000;
+  s->r_capacity = 10;
+  s->util_max = 0.9;
   iar = 1200;
-  gmt = 0.0;
-  q = 0;
-  narr = 0;
-  nloss = 0;
-  q_sum = 0;
-  q_len = 0;
-  buffer_size *= 1024;     /* converts size from MB to B (i.e. octets) */
-  iat = 1.0 / iar;
-  schedule(negexp(iat), ARRIVAL); /* schedule the first arrival */
+  s->buffer_size = buffer_kb * 1024;     /* converts size from KB to B (i.e. octets) */
+  gw_start(s, iar);
 }
 /**************************************************************************/
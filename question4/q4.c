@@ -3,10 +3,18 @@
 #include <math.h>
 #include <time.h>
 #include <limits.h>
+#include <unistd.h>
 
-#define NEW(type) (type *) malloc(sizeof(type))
-#define ARRIVAL 1
-#define DEPARTURE 2
+#include "../common/rng.h"
+#include "../common/grid.h"
+
+/* weighted fair discard between the batch host and the others */
+#define GW_POLICY	gw_admit_fair
+#define GW_BATCH	1
+#define GW_STATS	GW_STAT_DELAY
+#define GW_EVLOG	1	/* -e: log every packet event */
+#define GW_TICKS	1	/* integer clock: long runs keep their event order */
+#include "../common/gateway.h"
 
 #define G_CAPACITY 10        /* gateway processing capacity */
 #define MEAN_PKT_LENGTH 1000 /* mean packet length */
@@ -15,283 +23,231 @@
 #define NUM_HOSTS 10         /* number of hosts */
 #define BUFFER_SIZE 41984    /* max buffer size to hold packets */
 #define TOTAL_EVENTS 10000   /* number of events to be simulated */
-#define R (BUFFER_SIZE * 0.75) /* threshold parameter which triggers discard of packet */
+#define R 0.75               /* threshold, as a fraction of the buffer, which triggers discard of packet */
 #define Z 0.95
 
-double 
-gmt,        /* absolute time */
-iat,        /* mean interarrival time */
-W,          /* weight ratio for each host */
-batch_time, /* time that batched packets spent in the system */
-packet_time; /* time that individual packets spent in the system */
-
-
-int
-q,             /* number of packets in the system */
-narr,          /* number of arrivals */
-nloss,         /* number of lost single arrival packets */
-batch_nloss,   /* number of lost batch arrival packets */
-q_sum,         /* sum of queue lengths at arrival instants */ 
-q_len,         /* queue length n octets */ 
-iar,           /* mean packet arrival rate */
-batch_size,    /* number of packets in each batch arrival */     
-num_packets,   /* the number of packets to add to the buffer in an arrrival */
-batch_qlen,    /* sum of the batch packet lengths in q_len */
-total_packets, /* total number of packets that passed through the system */
-batch_packets, /* number of batch packets that passed through the system */
-batch_arrival, /* keeps track of whether an arrival is a batch or single arrival */
-batch_interval;/* keeps track of when the next batch process should be scheduled */
+/* parameters of a run, and their defaults when not swept */
+#define P_IAR		0
+#define P_BUFFER	1
+#define P_BAR		2
+#define P_HOSTS		3
+#define P_BATCH_HOSTS	4
+#define P_R		5
+#define P_Z		6
+#define P_EVENTS	7
+#define P_REP		8	/* replication number: the random stream used */
+#define NPARAMS		9
+
+GRID_PARAM params[NPARAMS] = {
+	{"iar", 100, NULL, 0}, {"buffer", BUFFER_SIZE, NULL, 0}, {"bar", BAR, NULL, 0},
+	{"hosts", NUM_HOSTS, NULL, 0}, {"batch_hosts", BATCH_HOSTS, NULL, 0}, {"R", R, NULL, 0},
+	{"Z", Z, NULL, 0}, {"events", TOTAL_EVENTS, NULL, 0}, {"rep", 0, NULL, 0}
+};
+
+SIM
+sim;    /* the gateway */
 
 long
 seed;   /* seed for the random number generator */
 
-typedef struct schedule_info{
-	double time;                       /* Time that event occurs */
-	int event_type;                    /* Type of event */
-	struct schedule_info *next;        /* Pointer to next item in linked list */
-} EVENTLIST;
+EVLOG
+*evlog; /* -e: the event log of the one point, or NULL */
 
-typedef struct packet_info{
-	int pkt_len;                       /* Length of packet */ 
-	int batch;						   /* keeps track of whether a particular packet is part of a batch arrival */
-	double arrival_time;			   /* time that the packet arrived in the system */
-	struct packet_info *next;          /* Pointer to next packet in linked list */
-} PACKET_Q;
+SNAP
+start;  /* -R, -F: the saved state every point starts from */
 
-struct schedule_info
-*head,
-*tail;
+int
+fork_mode; /* -F: points apply their own parameters to that state */
 
-struct packet_info
-*headPkt,
-*tailPkt;
+SIM
+*kept;  /* -S: the SIM that ran the one point */
 
-int  act(void);
-double  negexp(double);
-double  srv_time(int);
-void arrival(void);
-void departure(void);
-void schedule(double, int);
 void sim_init(void);
+void sim_setup(SIM *, const double *);
+void sim_config(SIM *, const double *);
+void sim_seed(SIM *, const double *);
+void point(const double *, double *, int, void *);
 
 /**************************************************************************/
-main(){
-	
-	sim_init();
-	
+int main(int argc, char *argv[]){
+	GRID g = {params, NPARAMS};
+	SIM *sims;
+	int c, i, nthreads = runner_threads();
+	const char *evfile = NULL, *savefile = NULL, *loadfile = NULL;
+	
+	if (argc == 1) {
+		sim_init();
+		
+		gw_simulate(&sim, sim.total_events);
+		gw_prof_dump(&sim, stderr);
+		
+		printf("Probablity a packet is blocked: \nbatch arrival: %8.4f \nsingle packet arrival: %8.4f\n\n",
+		 ((float) sim.batch_nloss) / sim.batch_packets, ((float) sim.nloss) / (sim.total_packets - sim.batch_packets));
+		
+		printf("Mean packet delay in the gateway was: \nbatch arrival: %8.4f (sd %8.4f)\nsingle packet arrival: %8.4f (sd %8.4f)\n",
+		 sim.batch_delay.mean, sqrt(stat_var(&sim.batch_delay)), sim.packet_delay.mean, sqrt(stat_var(&sim.packet_delay)));
+		
+		gw_free(&sim);
+		return(0);
+	}
 	
-	while (narr < TOTAL_EVENTS){
-		switch (act()){
-			case ARRIVAL:
-				arrival();
+	/* sweep: one row per point of the grid */
+	seed = time(NULL);
+	while ((c = getopt(argc, argv, "e:f:p:t:s:S:R:F:")) != -1) {
+		switch (c) {
+			case 'e':
+				evfile = optarg;
+				break;
+			case 'S':
+				savefile = optarg;
+				break;
+			case 'F':
+				fork_mode = 1;
+				/* fall through */
+			case 'R':
+				loadfile = optarg;
+				break;
+			case 'f':
+				if (grid_read(&g, optarg) < 0)
+					exit(1);
 				break;
-			case DEPARTURE:
-				departure();
+			case 'p':
+				if (grid_parse(&g, optarg) < 0)
+					exit(1);
+				break;
+			case 't':
+				nthreads = atoi(optarg);
+				break;
+			case 's':
+				seed = atol(optarg);
 				break;
 			default:
-				printf("error in act procedure\n");
+				fprintf(stderr, "usage: %s [-p name=values]... [-f file] [-e log] [-S save] [-R|-F saved]\n"
+						"\t[-t threads] [-s seed]\n"
+						"\tparameters: iar buffer bar hosts batch_hosts R Z events rep\n", argv[0]);
 				exit(1);
-				break;
-		} /* end switch */
-	}      /* end while */
-	
-	printf("Probablity a packet is blocked: \nbatch arrival: %8.4f \nsingle packet arrival: %8.4f\n\n",
-	 ((float) batch_nloss) / batch_packets, ((float) nloss) / (total_packets - batch_packets));
-	
-	printf("Mean packet delay in the gateway was: \nbatch arrival: %8.4f \nsingle packet arrival: %8.4f\n", ((float)batch_time / batch_packets), ((float) packet_time) / (total_packets - batch_packets));
-	
-	//printf("%f,%f,%f,%f\n", ((float) batch_nloss) / batch_packets, ((float) nloss) / (total_packets - batch_packets), ((float)batch_time / batch_packets), ((float) packet_time) / (total_packets - batch_packets));
-	
+		}
+	}
+	if (nthreads < 1)
+		nthreads = 1;
+	/* every run needs an arrival, and keeps the count in an int */
+	if (grid_check(&g, P_EVENTS, 1, INT_MAX) < 0)
+		exit(1);
+	if ((evfile != NULL || savefile != NULL) && grid_size(&g) != 1) {
+		fprintf(stderr, "q4: -e and -S are for a single point\n");
+		exit(1);
+	}
+	if (evfile != NULL && (evlog = evlog_open(evfile)) == NULL)
+		exit(1);
+	sims = (SIM *) calloc(nthreads, sizeof(SIM));
+	/* check the saved state before any point relies on it */
+	if (loadfile != NULL && (snap_read(&start, loadfile) < 0 || gw_load(&sims[0], &start) < 0))
+		exit(1);
+	if (grid_sweep(&g, nthreads, "batch_loss single_loss batch_delay single_delay",
+			4, point, sims, stdout) < 0)
+		exit(1);
+	if (evlog != NULL && evlog_close(evlog) < 0)
+		exit(1);
+	if (savefile != NULL) {
+		snap_clear(&start);
+		gw_save(kept, &start);
+		if (snap_write(&start, savefile) < 0)
+			exit(1);
+	}
+	snap_free(&start);
+	for (i = 0; i < nthreads; ++i)
+		gw_free(&sims[i]);
+	free(sims);
+	grid_free(&g);
 	return(0);
 	
 } /* end main */
 /**************************************************************************/
-double negexp(double mean) /* returns a negexp rv with mean `mean' */
-
-{
-	return (- log(drand48()) * mean);
-}
-
-/**************************************************************************/
-double srv_time(int pkt_length) /* returns the service time for given length */
-
-{
-	double service_time = (pkt_length*8.0)/(G_CAPACITY*pow(10.0,6.0));
-	return (service_time);
-}
-
-/**************************************************************************/
-void arrival() /* a customer arrives */
-
+void point(const double *x, double *res, int worker, void *arg)
+/* runs one point of a sweep */
 {
-	int i;
-	struct packet_info *t, *x;
-	narr += 1;                /* keep tally of number of arrivals */
-	q_sum += q;
-	schedule(negexp(iat), ARRIVAL); /* schedule the next arrival */
+	SIM *s = &((SIM *) arg)[worker];
 	
-	/* check whether to schedule a batch or individual packet arrival */
-	if (batch_interval == 1 || narr % batch_interval == 0) {
-		num_packets = batch_size;
-		batch_arrival = 1;
-		batch_packets += num_packets;
-	}
+	if (start.len == 0)
+		sim_setup(s, x);
 	else {
-		num_packets = 1;
-		batch_arrival = 0;
-	}
-	
-	/* Create the appropriate number of packets for the type of arrival */
-	for (i = 0; i < num_packets; ++i) { 
-		total_packets += 1;
-		int new_pkt_len = (int)(-log(drand48()) * MEAN_PKT_LENGTH); 
-		
-		if (q_len == 0) {
-			W = 0;
-		}
-		else {
-			if (batch_arrival) {
-				W = (batch_qlen * NUM_HOSTS)/ ((float) q_len);
-			}
-			else {
-				W = (((q_len - batch_qlen) * NUM_HOSTS) / ((float) q_len)) / (((float) NUM_HOSTS) - BATCH_HOSTS);
-			}
-		}
-		
-		if (!(q_len > R && W > (Z * ((BUFFER_SIZE - R)/(q_len - R))))) {
-			/* still space in buffer */
-			q += 1;
-			q_len += new_pkt_len;
-			t = NEW(PACKET_Q);
-			for(x=headPkt ; x->next!=tailPkt ; x=x->next);
-			t->pkt_len = new_pkt_len;
-			t->arrival_time = gmt;
-			t->next = x->next;
-			x->next = t;
-			
-			if (batch_arrival) {
-				batch_qlen += new_pkt_len;
-				t->batch = 1;
-			}
-			
-			if (q == 1)
-				schedule(srv_time(headPkt->next->pkt_len), DEPARTURE);
-		}
-		else {
-			/* buffer is full; packet is dropped */
-			if (batch_arrival) {
-				batch_nloss += 1;
-			}
-			else {
-				nloss += 1;
-			}
+		/* -R carries on with the saved run for another 'events'
+		   arrivals; -F starts the point from the saved state with its
+		   own parameters and streams, counting afresh */
+		if (gw_load(s, &start) < 0)
+			exit(1);
+		if (fork_mode) {
+			sim_config(s, x);
+			gw_derive(s, (int) x[P_IAR]);
+			sim_seed(s, x);
+			gw_clear(s);
 		}
+		else
+			s->total_events = (int) x[P_EVENTS];
 	}
+	gw_evlog(s, evlog);
+	gw_simulate(s, s->narr + s->total_events);
+	gw_evlog(s, NULL);
+	kept = s;
+	gw_prof_dump(s, stderr);
+	/* a point with no batches (bar or batch_hosts 0), or no single
+	   packets, has no loss of that class */
+	res[0] = s->batch_packets > 0 ? (double) s->batch_nloss / s->batch_packets : 0;
+	res[1] = s->total_packets > s->batch_packets ?
+	         (double) s->nloss / (s->total_packets - s->batch_packets) : 0;
+	res[2] = s->batch_delay.mean;
+	res[3] = s->packet_delay.mean;
 }
 
-/**************************************************************************/
-void departure()  /* a customer departs */
-
-{
-	struct packet_info *x;
-	q -= 1;
-	x = headPkt->next;                 /* Delete event from linked list */
-	q_len -= x->pkt_len;
-	
-	if (x->batch) {
-		batch_qlen -= x->pkt_len;
-		batch_time += gmt - x->arrival_time;
-	}
-	else {
-		packet_time += gmt - x->arrival_time;
-	}
-	
-	headPkt->next = headPkt->next->next;
-	free(x);
-	if (q > 0)
-		schedule(srv_time(headPkt->next->pkt_len), DEPARTURE);
-}
-
-/**************************************************************************/
-
-
-/**************************************************************************/
-void schedule(double time_interval, int event)  /* Schedules an event of type */
-/* 'event' at time 'time_interval' 
- in the future */
-
-{
-	double 
-	event_time;
-	
-	struct schedule_info
-	*x,
-	*t;
-	
-	event_time = gmt + time_interval;
-	t = NEW(EVENTLIST);
-	for(x=head ; x->next->time<event_time && x->next!=tail ; x=x->next);
-	t->time = event_time;
-	t->event_type = event;
-	t->next = x->next;
-	x->next = t;
-}
-/**************************************************************************/
-int act()    /* find the next event  and go to it */
-{
-	int 
-	type;
-	struct schedule_info 
-	*x;
-	
-	gmt = head->next->time; /* step time forward to the next event */
-	type = head->next->event_type; /*  Record type of this next event */
-	x = head->next;                 /* Delete event from linked list */
-	head->next = head->next->next;
-	free(x);
-	return type; /* return value is type of the next event */
-}
-/*************************************************************************/
 /**************************************************************************/
 void sim_init()
 /* initialise the simulation */
 
 { 
+	double x[NPARAMS];
+	int i, iar;
 	
     printf("\nenter the mean packet arrival rate (pkts/sec)\n");
 	scanf("%d", &iar);
 	
 	/* providing automated seed from system time */
 	seed = time(NULL);
-	srand48(seed);
-	
-	head = NEW(EVENTLIST);
-	tail = NEW(EVENTLIST);
-	head->next = tail;
-	tail->next = tail;
-	
-	headPkt = NEW(PACKET_Q);
-	tailPkt = NEW(PACKET_Q);
-	headPkt->next = tailPkt;
-	tailPkt->next = tailPkt;
+	for (i = 0; i < NPARAMS; ++i)
+		x[i] = params[i].def;
+	x[P_IAR] = iar;
+	sim_setup(&sim, x);
+}
+/**************************************************************************/
+void sim_setup(SIM *s, const double *x)
+/* configures and starts s for the parameters x */
+
+{ 
+	sim_seed(s, x);
+	sim_config(s, x);
+	gw_start(s, (int) x[P_IAR]);
+}
+
+void sim_seed(SIM *s, const double *x)
+/* puts s on the random streams of x's rep, dropping buffered variates */
+{
+	long stream = (long) x[P_REP];
 	
-	gmt = 0.0;
-	q = 0;
-	narr = 0;
-	nloss = 0;
-	batch_nloss = 0;
-	q_sum = 0;
-	q_len = 0;
-	W = 0;
-	batch_qlen = 0;
-	batch_time = 0;
-	packet_time = 0;
-	batch_packets = 0;
-	total_packets = 0;
-	batch_size = iar/BAR; 
-	iar = (BATCH_HOSTS * BAR) + ((NUM_HOSTS - BATCH_HOSTS) * iar);
-	batch_interval = iar / (BAR * BATCH_HOSTS);
-	iat = 1.0 / iar;
-	schedule(negexp(iat), ARRIVAL); /* schedule the first arrival */
+	rng_seed(s->arr.rng, seed, stream * RNG_SUBSTREAMS + 1);
+	rng_seed(s->len.rng, seed, stream * RNG_SUBSTREAMS + 2);
+	expgen_reset(&s->arr);
+	expgen_reset(&s->len);
+}
+
+void sim_config(SIM *s, const double *x)
+/* sets the configuration of s from the parameters x */
+{
+	s->r_capacity = G_CAPACITY;
+	s->mean_pkt_length = MEAN_PKT_LENGTH;
+	s->buffer_size = (int) x[P_BUFFER];
+	s->bar = (int) x[P_BAR];
+	s->hosts = (int) x[P_HOSTS];
+	s->batch_hosts = (int) x[P_BATCH_HOSTS];
+	s->discard_r = x[P_R] * s->buffer_size;
+	s->discard_z = x[P_Z];
+	s->total_events = (int) x[P_EVENTS];
 }
-/**************************************************************************/
\ No newline at end of file
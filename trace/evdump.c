@@ -0,0 +1,131 @@
+/* program evdump.c */
+
+/* Prints an event log written by common/evlog.h (q4 -e) as text.
+
+   usage:  evdump [-k enq|deq|drop] [-c class] [-n lines] [-s] log
+
+   One line per event, after a header with the configuration:
+
+       time kind class len q_len share W
+
+   where W is the class's weight as gw_admit_fair sees it: its share of
+   the buffer over its share of the hosts.  With -s, only a summary:
+   the events of each kind per class, and the drops by how full the
+   buffer was, in tenths of it. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../common/evlog.h"
+
+#define BINS	10
+
+const char *kinds[] = { "enq", "deq", "drop" };
+
+double weight(const EVLOG_HEAD *, const EVLOG_REC *);
+
+/**************************************************************************/
+int main(int argc, char *argv[]){
+	EVLOG_HEAD h;
+	EVLOG_REC r[4096];
+	FILE *f;
+	int c, i, kind = -1, cls = -1, summary = 0, bin;
+	long lines = -1, k, n, count[2][3] = {{0}}, drops[2][BINS + 1] = {{0}};
+
+	while ((c = getopt(argc, argv, "k:c:n:s")) != -1) {
+		switch (c) {
+			case 'k':
+				for (kind = 2; kind >= 0 && strcmp(optarg, kinds[kind]) != 0; --kind)
+					;
+				if (kind < 0)
+					goto usage;
+				break;
+			case 'c':
+				cls = atoi(optarg);
+				break;
+			case 'n':
+				lines = atol(optarg);
+				break;
+			case 's':
+				summary = 1;
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if (optind != argc - 1) {
+	usage:
+		fprintf(stderr, "usage: %s [-k enq|deq|drop] [-c class] [-n lines] [-s] log\n", argv[0]);
+		exit(1);
+	}
+	if ((f = fopen(argv[optind], "rb")) == NULL) {
+		fprintf(stderr, "evdump: cannot open %s\n", argv[optind]);
+		exit(1);
+	}
+	if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, EVLOG_MAGIC, 8) != 0 ||
+	    h.bom != EVLOG_BOM || h.rec_size != sizeof(EVLOG_REC)) {
+		fprintf(stderr, "evdump: %s is not an event log of this machine\n", argv[optind]);
+		exit(1);
+	}
+	h.policy[sizeof(h.policy) - 1] = '\0';
+	printf("# %s buffer %d hosts %d batch_hosts %d R %.0f Z %g: %llu events\n",
+	       h.policy, h.buffer_size, h.hosts, h.batch_hosts, h.discard_r, h.discard_z,
+	       (unsigned long long) h.count);
+	if (!summary)
+		printf("# time kind class len q_len share W\n");
+
+	for (k = 0; k < (long) h.count && lines != 0; ) {
+		n = (long) h.count - k < 4096 ? (long) h.count - k : 4096;
+		if ((n = fread(r, sizeof(EVLOG_REC), n, f)) <= 0) {
+			fprintf(stderr, "evdump: %s is cut short\n", argv[optind]);
+			exit(1);
+		}
+		k += n;
+		for (i = 0; i < n && lines != 0; ++i) {
+			if ((kind >= 0 && r[i].kind != kind) || (cls >= 0 && r[i].cls != cls) ||
+			    r[i].kind > EVLOG_DROP)
+				continue;
+			if (summary) {
+				count[r[i].cls != 0][r[i].kind] += 1;
+				if (r[i].kind == EVLOG_DROP && h.buffer_size > 0) {
+					bin = (int) ((double) BINS * r[i].q_len / h.buffer_size);
+					drops[r[i].cls != 0][bin < 0 ? 0 : bin > BINS ? BINS : bin] += 1;
+				}
+				continue;
+			}
+			printf("%.9f %s %d %d %d %d %.4f\n", r[i].time, kinds[r[i].kind], r[i].cls,
+			       r[i].len, r[i].q_len, r[i].share, weight(&h, &r[i]));
+			if (lines > 0)
+				--lines;
+		}
+	}
+	fclose(f);
+
+	if (summary) {
+		printf("# class enq deq drop loss\n");
+		for (c = 0; c < 2; ++c)
+			printf("%d %ld %ld %ld %.6f\n", c, count[c][EVLOG_ENQ], count[c][EVLOG_DEQ],
+			       count[c][EVLOG_DROP], count[c][EVLOG_ENQ] + count[c][EVLOG_DROP] > 0 ?
+			       (double) count[c][EVLOG_DROP] / (count[c][EVLOG_ENQ] + count[c][EVLOG_DROP]) : 0.0);
+		printf("# drops by q_len/buffer: from to class0 class1\n");
+		for (i = 0; i <= BINS; ++i)
+			if (drops[0][i] + drops[1][i] > 0)
+				printf("%.1f %.1f %ld %ld\n", (double) i / BINS, (double) (i + 1) / BINS,
+				       drops[0][i], drops[1][i]);
+	}
+	return 0;
+}
+
+/**************************************************************************/
+double weight(const EVLOG_HEAD *h, const EVLOG_REC *r)
+/* W of the packet's class: its share of q_len over its share of hosts */
+{
+	int hosts = r->cls ? h->batch_hosts : h->hosts - h->batch_hosts;
+
+	if (r->q_len <= 0 || hosts <= 0 || h->hosts <= 0)
+		return 0;
+	return ((double) r->share / r->q_len) / ((double) hosts / h->hosts);
+}
+/**************************************************************************/
@@ -0,0 +1,178 @@
+/* program replay.c */
+
+/* Trace-driven gateway: the drop-tail gateway of question2, fed by the
+   packets of a recorded trace (common/trace.h) instead of a Poisson
+   stream.  The trace is cut into segments of equal numbers of packets,
+   each replayed from an empty buffer as one replication, in parallel,
+   so that the lines carry confidence intervals as the other programs'
+   do.  Packets of class 1 count as batch traffic.
+
+   usage:  replay [-b kb[,kb...]] [-u util] [-c capacity] [-n segments]
+                  [-t threads] trace
+
+   One line per buffer size:
+
+       KB loss hw batch_loss q hw delay hw
+
+   with the loss over all packets, the loss of the class 1 packets, the
+   mean number in the system seen by arrivals and the mean time in the
+   system of admitted packets. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "../common/runner.h"
+#include "../common/stats.h"
+
+/* drop-tail, and no admission while utilisation is above util_max */
+#define GW_POLICY	gw_admit_util
+#define GW_BATCH	1
+#define GW_STATS	GW_STAT_DELAY
+#define GW_TRACE	1
+#include "../common/gateway.h"
+
+#define R_CAPACITY	10	/* gateway processing capacity in Mbit/s */
+#define UTIL_MAX	0.9
+#define SEGMENTS	10	/* default replications */
+#define SEG_MAX		10000000L	/* most packets in one, for the int tallies */
+#define MAX_SIZES	64
+
+/* Running totals of the segments of one buffer size */
+typedef struct{
+  STAT loss;        /* loss probability */
+  STAT batch_loss;  /* of class 1 packets, over segments that have them */
+  STAT qlen;        /* mean number in the system seen by arrivals */
+  STAT delay;       /* mean time in the system of admitted packets */
+  } TALLY;
+
+/* The segments of one buffer size, shared out between the workers */
+typedef struct{
+  TRACE trace;
+  int kb;           /* buffer size in KB */
+  int capacity;     /* Mbit/s */
+  double util;      /* util_max */
+  long seg_len;     /* packets in each segment */
+  SIM *sim;         /* one per worker */
+  TALLY *part;      /* part[worker]: this size's totals */
+  } SWEEP;
+
+void replicate(int, int, void *);
+
+/**************************************************************************/
+int main(int argc, char *argv[]){
+	SWEEP w;
+	TALLY t;
+	int kb[MAX_SIZES] = { 41 };
+	int c, i, k, nsizes = 1, segments = 0;
+	int nthreads = runner_threads();
+	char *p;
+
+	memset(&w, 0, sizeof(w));
+	w.capacity = R_CAPACITY;
+	w.util = UTIL_MAX;
+	while ((c = getopt(argc, argv, "b:u:c:n:t:")) != -1) {
+		switch (c) {
+			case 'b':
+				for (nsizes = 0, p = optarg; nsizes < MAX_SIZES && *p != '\0'; ++nsizes) {
+					kb[nsizes] = strtol(p, &p, 10);
+					if (*p == ',')
+						++p;
+				}
+				break;
+			case 'u':
+				w.util = atof(optarg);
+				break;
+			case 'c':
+				w.capacity = atoi(optarg);
+				break;
+			case 'n':
+				segments = atoi(optarg);
+				break;
+			case 't':
+				nthreads = atoi(optarg);
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if (optind != argc - 1) {
+	usage:
+		fprintf(stderr, "usage: %s [-b kb[,kb...]] [-u util] [-c capacity] [-n segments]\n"
+				"\t[-t threads] trace\n", argv[0]);
+		exit(1);
+	}
+	if (trace_open(&w.trace, argv[optind]) < 0)
+		exit(1);
+	if (w.trace.count < 2 || trace_rate(&w.trace) <= 0) {
+		fprintf(stderr, "replay: %s needs two packets at different times\n", argv[optind]);
+		exit(1);
+	}
+	if (segments < 1)
+		segments = SEGMENTS;
+	if (w.trace.count / segments > SEG_MAX)
+		segments = (w.trace.count + SEG_MAX - 1) / SEG_MAX;
+	if (segments > w.trace.count)
+		segments = w.trace.count;
+	w.seg_len = w.trace.count / segments;  /* the remainder is not replayed */
+	if (nthreads < 1)
+		nthreads = 1;
+	w.sim = (SIM *) calloc(nthreads, sizeof(SIM));
+	w.part = (TALLY *) malloc(nthreads * sizeof(TALLY));
+
+	printf("# %ld packets at %.1f/s in %d segments of %ld\n",
+	       w.trace.count, trace_rate(&w.trace), segments, w.seg_len);
+	for (k = 0; k < nsizes; ++k) {
+		w.kb = kb[k];
+		memset(&t, 0, sizeof(TALLY));
+		for (i = 0; i < nthreads; ++i)
+			memset(&w.part[i], 0, sizeof(TALLY));
+		runner_run(nthreads, segments, replicate, &w);
+		for (i = 0; i < nthreads; ++i) {
+			stat_merge(&t.loss, &w.part[i].loss);
+			stat_merge(&t.batch_loss, &w.part[i].batch_loss);
+			stat_merge(&t.qlen, &w.part[i].qlen);
+			stat_merge(&t.delay, &w.part[i].delay);
+		}
+		printf("%d %.6f %.6f %.6f q %.4f %.4f delay %.6f %.6f\n", w.kb,
+		       t.loss.mean, stat_hw(&t.loss), t.batch_loss.mean,
+		       t.qlen.mean, stat_hw(&t.qlen), t.delay.mean, stat_hw(&t.delay));
+	}
+
+	for (i = 0; i < nthreads; ++i)
+		gw_free(&w.sim[i]);
+	free(w.sim);
+	free(w.part);
+	trace_close(&w.trace);
+	return 0;
+}
+
+/**************************************************************************/
+void replicate(int job, int worker, void *arg) /* replays segment 'job' */
+{
+	SWEEP *w = (SWEEP *) arg;
+	SIM *s = &w->sim[worker];
+	STAT d = {0};
+
+	s->r_capacity = w->capacity;
+	s->util_max = w->util;
+	s->buffer_size = w->kb * 1024;
+	s->hosts = 1;                      /* no synthetic batches */
+	s->batch_hosts = 0;
+	trace_cursor(&s->trace, &w->trace, job * w->seg_len, w->seg_len);
+	gw_start(s, (int) (trace_rate(&w->trace) + 0.5));
+	gw_simulate(s, w->seg_len);
+	gw_prof_dump(s, stderr);
+
+	stat_add(&w->part[worker].loss,
+	         (double) (s->nloss + s->batch_nloss) / s->total_packets);
+	if (s->batch_packets > 0)
+		stat_add(&w->part[worker].batch_loss, (double) s->batch_nloss / s->batch_packets);
+	stat_add(&w->part[worker].qlen, (double) s->q_sum / s->narr);
+	stat_merge(&d, &s->packet_delay);
+	stat_merge(&d, &s->batch_delay);
+	stat_add(&w->part[worker].delay, d.mean);
+}
+/**************************************************************************/
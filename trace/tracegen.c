@@ -0,0 +1,160 @@
+/* program tracegen.c */
+
+/* Writes a binary packet trace (common/trace.h) for replay.c, either
+   synthetic or converted from text.
+
+   usage:  tracegen [-r iar] [-m mean] [-n packets] [-H hosts]
+                    [-b bar] [-k batch] [-s seed] out
+           tracegen -i text out
+
+   Synthetic traffic is the other programs': Poisson arrivals of iar
+   packets a second with negexp lengths of the given mean, spread at
+   random over the hosts, and with -b, one more host sending bar batches
+   a second of 'batch' packets each (class 1), all at one instant.
+
+   A text trace ('-' for stdin) has one packet per line, in order of
+   time, as "seconds octets [host [class]]", which is what, for example,
+   tcpdump -tt output reduces to with awk; '#' starts a comment. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../common/rng.h"
+#include "../common/expgen.h"
+#include "../common/trace.h"
+
+#define IAR		1200
+#define MEAN_PKT_LENGTH	1000
+#define PACKETS		10000000L
+#define BATCH		10
+
+long synthetic(FILE *, int, int, long, int, int, int, long);
+long convert(FILE *, FILE *);
+
+/**************************************************************************/
+int main(int argc, char *argv[]){
+	FILE *f, *in = NULL;
+	int c, iar = IAR, mean = MEAN_PKT_LENGTH, hosts = 1, bar = 0, batch = BATCH;
+	long n = PACKETS, seed = time(NULL), count;
+
+	while ((c = getopt(argc, argv, "r:m:n:H:b:k:s:i:")) != -1) {
+		switch (c) {
+			case 'r':
+				iar = atoi(optarg);
+				break;
+			case 'm':
+				mean = atoi(optarg);
+				break;
+			case 'n':
+				n = atol(optarg);
+				break;
+			case 'H':
+				hosts = atoi(optarg);
+				break;
+			case 'b':
+				bar = atoi(optarg);
+				break;
+			case 'k':
+				batch = atoi(optarg);
+				break;
+			case 's':
+				seed = atol(optarg);
+				break;
+			case 'i':
+				in = strcmp(optarg, "-") == 0 ? stdin : fopen(optarg, "r");
+				if (in == NULL) {
+					fprintf(stderr, "tracegen: cannot open %s\n", optarg);
+					exit(1);
+				}
+				break;
+			default:
+				goto usage;
+		}
+	}
+	if (optind != argc - 1 || iar <= 0 || hosts < 1 || hosts > 65535 || batch < 1) {
+	usage:
+		fprintf(stderr, "usage: %s [-r iar] [-m mean] [-n packets] [-H hosts] [-b bar] [-k batch]\n"
+				"\t[-s seed] out\n"
+				"       %s -i text out\n", argv[0], argv[0]);
+		exit(1);
+	}
+	if ((f = trace_create(argv[optind])) == NULL)
+		exit(1);
+	count = in != NULL ? convert(in, f) : synthetic(f, iar, mean, n, hosts, bar, batch, seed);
+	if (count < 0 || trace_finish(f, count) < 0)
+		exit(1);
+	fprintf(stderr, "tracegen: %ld packets\n", count);
+	return 0;
+}
+
+/**************************************************************************/
+long synthetic(FILE *f, int iar, int mean, long n, int hosts, int bar, int batch, long seed)
+/* writes n Poisson packets, and the batches; returns the count */
+{
+	EXPGEN arr = {0}, len = {0};
+	unsigned short rng[3];
+	double t = 0, tb = HUGE_VAL;
+	long count = 0;
+	int i;
+
+	rng_seed(rng, seed, 0);
+	rng_seed(arr.rng, seed, 1);
+	rng_seed(len.rng, seed, 2);
+	t = expgen_next(&arr) / iar;
+	if (bar > 0)
+		tb = expgen_next(&arr) / bar;
+	while (count < n) {
+		if (tb < t) {
+			for (i = 0; i < batch && count < n; ++i, ++count)
+				trace_put(f, (uint64_t) (tb * 1e9 + 0.5),
+				          (uint32_t) (expgen_next(&len) * mean), hosts, 1);
+			tb += expgen_next(&arr) / bar;
+			continue;
+		}
+		trace_put(f, (uint64_t) (t * 1e9 + 0.5), (uint32_t) (expgen_next(&len) * mean),
+		          nrand48(rng) % hosts, 0);
+		t += expgen_next(&arr) / iar;
+		++count;
+	}
+	return count;
+}
+
+long convert(FILE *in, FILE *f)
+/* writes the packets of a text trace; returns the count, or -1 after a
+   message */
+{
+	char line[1024], *s;
+	double t, t0 = 0;
+	uint64_t ns, last = 0;
+	long count = 0, no = 0;
+	int len, host, cls;
+
+	while (fgets(line, sizeof(line), in) != NULL) {
+		++no;
+		if ((s = strchr(line, '#')) != NULL)
+			*s = '\0';
+		host = cls = 0;
+		if (sscanf(line, "%lf %d %d %d", &t, &len, &host, &cls) < 2) {
+			if (strspn(line, " \t\r\n") == strlen(line))
+				continue;
+			fprintf(stderr, "tracegen: cannot read line %ld\n", no);
+			return -1;
+		}
+		if (count == 0)
+			t0 = t;
+		ns = (uint64_t) ((t - t0) * 1e9 + 0.5);
+		if (t < t0 || ns < last || len < 0) {
+			fprintf(stderr, "tracegen: line %ld is out of order or has a negative length\n", no);
+			return -1;
+		}
+		trace_put(f, ns, len, host, cls);
+		last = ns;
+		++count;
+	}
+	return count;
+}
+/**************************************************************************/